@@ -0,0 +1,237 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Generated by kodu_schema -cs from MicrobitHex/source/Commands.h. Do not edit.
+
+namespace Boku.Input
+{
+    /// <summary>
+    /// Writes each micro:bit command's opcode and fixed fields, in the order the
+    /// firmware reads them. Any repeated or optional part is written after.
+    /// </summary>
+    public static class MicroBitCommands
+    {
+        public static void WriteScrollImages(MicroBitMessageWriter writer, int delayMs, int brightness, int count)
+        {
+            writer.WriteChar('A');
+            writer.WriteU16Hex(delayMs);
+            writer.WriteU8Hex(brightness);
+            writer.WriteU8Hex(count);
+        }
+
+        public static void WritePrintImages(MicroBitMessageWriter writer, int durationMs, int brightness, int count)
+        {
+            writer.WriteChar('B');
+            writer.WriteU16Hex(durationMs);
+            writer.WriteU8Hex(brightness);
+            writer.WriteU8Hex(count);
+        }
+
+        public static void WriteScrollText(MicroBitMessageWriter writer, int delayMs, int brightness, string text)
+        {
+            writer.WriteChar('C');
+            writer.WriteU16Hex(delayMs);
+            writer.WriteU8Hex(brightness);
+            writer.WriteString(text);
+        }
+
+        public static void WritePrintText(MicroBitMessageWriter writer, int durationMs, int brightness, string text)
+        {
+            writer.WriteChar('D');
+            writer.WriteU16Hex(durationMs);
+            writer.WriteU8Hex(brightness);
+            writer.WriteString(text);
+        }
+
+        public static void WriteConfigInputPin(MicroBitMessageWriter writer, int pin, int pinMode)
+        {
+            writer.WriteChar('E');
+            writer.WriteU8Hex(pin);
+            writer.WriteU8Hex(pinMode);
+        }
+
+        public static void WriteSetPinValue(MicroBitMessageWriter writer, int pin, int pinMode, int value)
+        {
+            writer.WriteChar('F');
+            writer.WriteU8Hex(pin);
+            writer.WriteU8Hex(pinMode);
+            writer.WriteU16Hex(value);
+        }
+
+        public static void WriteSetPinServoValue(MicroBitMessageWriter writer, int pin, int value)
+        {
+            writer.WriteChar('G');
+            writer.WriteU8Hex(pin);
+            writer.WriteU16Hex(value);
+        }
+
+        public static void WritePlayTones(MicroBitMessageWriter writer, int pin, int durationMs, int count)
+        {
+            writer.WriteChar('H');
+            writer.WriteU8Hex(pin);
+            writer.WriteU16Hex(durationMs);
+            writer.WriteU8Hex(count);
+        }
+
+        public static void WriteSetPixel(MicroBitMessageWriter writer, int x, int y, int brightness)
+        {
+            writer.WriteChar('I');
+            writer.WriteU8Hex(x);
+            writer.WriteU8Hex(y);
+            writer.WriteU8Hex(brightness);
+        }
+
+        public static void WritePrintDisplayFrames(MicroBitMessageWriter writer, int count)
+        {
+            writer.WriteChar('J');
+            writer.WriteU8Hex(count);
+        }
+
+        public static void WriteSetPinPwmOut(MicroBitMessageWriter writer, int pin, int frequencyHz, int frequencyMultiplier, int dutyCycle)
+        {
+            writer.WriteChar('K');
+            writer.WriteU8Hex(pin);
+            writer.WriteU16Hex(frequencyHz);
+            writer.WriteU16Hex(frequencyMultiplier);
+            writer.WriteU16Hex(dutyCycle);
+        }
+
+        public static void WriteRunBenchmarks(MicroBitMessageWriter writer)
+        {
+            writer.WriteChar('L');
+        }
+
+        public static void WriteConfigDisplayQueue(MicroBitMessageWriter writer, int depth, int policy)
+        {
+            writer.WriteChar('M');
+            writer.WriteU8Hex(depth);
+            writer.WriteU8Hex(policy);
+        }
+
+        public static void WriteConfigTelemetry(MicroBitMessageWriter writer, int rateHz, int policy, int windowSecs)
+        {
+            writer.WriteChar('N');
+            writer.WriteU8Hex(rateHz);
+            writer.WriteU8Hex(policy);
+            writer.WriteU8Hex(windowSecs);
+        }
+
+        public static void WriteConfigDelta(MicroBitMessageWriter writer, int keyframeTicks, int deadbandX, int deadbandY, int deadbandZ)
+        {
+            writer.WriteChar('O');
+            writer.WriteU8Hex(keyframeTicks);
+            writer.WriteU16Hex(deadbandX);
+            writer.WriteU16Hex(deadbandY);
+            writer.WriteU16Hex(deadbandZ);
+        }
+
+        public static void WritePing(MicroBitMessageWriter writer)
+        {
+            writer.WriteChar('P');
+        }
+
+        public static void WriteBatch(MicroBitMessageWriter writer, int count)
+        {
+            writer.WriteChar('Q');
+            writer.WriteU8Hex(count);
+        }
+
+        public static void WriteShowIcon(MicroBitMessageWriter writer, int icon, int brightness)
+        {
+            writer.WriteChar('R');
+            writer.WriteU8Hex(icon);
+            writer.WriteU8Hex(brightness);
+        }
+
+        public static void WriteStart(MicroBitMessageWriter writer)
+        {
+            writer.WriteChar('S');
+        }
+
+        public static void WritePlayMelody(MicroBitMessageWriter writer, int pin, int melody)
+        {
+            writer.WriteChar('T');
+            writer.WriteU8Hex(pin);
+            writer.WriteU8Hex(melody);
+        }
+
+        public static void WriteCacheFrames(MicroBitMessageWriter writer, int slot, int count, int delta)
+        {
+            writer.WriteChar('U');
+            writer.WriteU8Hex(slot);
+            writer.WriteU8Hex(count);
+            writer.WriteU8Hex(delta);
+        }
+
+        public static void WritePlayCachedFrames(MicroBitMessageWriter writer, int durationMs, int brightness, int loops, int count)
+        {
+            writer.WriteChar('V');
+            writer.WriteU16Hex(durationMs);
+            writer.WriteU8Hex(brightness);
+            writer.WriteU8Hex(loops);
+            writer.WriteU8Hex(count);
+        }
+
+        public static void WriteConfigEvents(MicroBitMessageWriter writer, int header)
+        {
+            writer.WriteChar('W');
+            writer.WriteU8Hex(header);
+        }
+
+        public static void WriteGetStats(MicroBitMessageWriter writer)
+        {
+            writer.WriteChar('X');
+        }
+
+        public static void WriteConfigAccel(MicroBitMessageWriter writer, int periodMs, int filter, int strength, int tilt)
+        {
+            writer.WriteChar('Y');
+            writer.WriteU8Hex(periodMs);
+            writer.WriteU8Hex(filter);
+            writer.WriteU8Hex(strength);
+            writer.WriteU8Hex(tilt);
+        }
+
+        public static void WriteConfigCompass(MicroBitMessageWriter writer, int heading)
+        {
+            writer.WriteChar('Z');
+            writer.WriteU8Hex(heading);
+        }
+
+        public static void WriteReliable(MicroBitMessageWriter writer, int seq, int crc)
+        {
+            writer.WriteChar('#');
+            writer.WriteU8Hex(seq);
+            writer.WriteU16Hex(crc);
+        }
+
+        public static void WriteUploadBegin(MicroBitMessageWriter writer, int length)
+        {
+            writer.WriteChar('<');
+            writer.WriteU16Hex(length);
+        }
+
+        public static void WriteUploadChunk(MicroBitMessageWriter writer, int offset)
+        {
+            writer.WriteChar('+');
+            writer.WriteU16Hex(offset);
+        }
+
+        public static void WriteUploadCommit(MicroBitMessageWriter writer)
+        {
+            writer.WriteChar('>');
+        }
+
+        public static void WriteCaptureAnalog(MicroBitMessageWriter writer, int pin, int periodUs, int decimation, int trigger, int level, int preTrigger, int count)
+        {
+            writer.WriteChar('~');
+            writer.WriteU8Hex(pin);
+            writer.WriteU16Hex(periodUs);
+            writer.WriteU8Hex(decimation);
+            writer.WriteU8Hex(trigger);
+            writer.WriteU16Hex(level);
+            writer.WriteU16Hex(preTrigger);
+            writer.WriteU16Hex(count);
+        }
+    }
+}
@@ -57,6 +57,13 @@ namespace Boku.Input
             WriteSeparater();
         }
 
+        public void WriteU32Hex(uint value)
+        {
+            WriteU16HexRaw((int)(value >> 16));
+            WriteU16HexRaw((int)(value & 0xFFFF));
+            WriteSeparater();
+        }
+
         private void WriteSeparater()
         {
             writer.Write('|');
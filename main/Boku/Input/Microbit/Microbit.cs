@@ -602,7 +602,7 @@ namespace Boku.Input
             // if version numbers match, we'll update the device to the READY state.
             if (!_port.IsOpen) return;
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_PING);
+            MicroBitCommands.WritePing(writer);
             QueueForSend(writer.ToString());
         }
 
@@ -614,7 +614,7 @@ namespace Boku.Input
             // if version numbers match, we'll update the device to the READY state.
             if (!_port.IsOpen) return;
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_START);
+            MicroBitCommands.WriteStart(writer);
             QueueForSend(writer.ToString());
         }
 
@@ -638,10 +638,7 @@ namespace Boku.Input
             _curr.Pins[pin].Value = value;
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_SET_PIN_VALUE);
-            writer.WriteU8Hex(pin);
-            writer.WriteU8Hex(operatingMode == EPinOperatingMode.Digital ? (int)EPinDigitalMode.Out : (int)EPinAnalogMode.Out);
-            writer.WriteU16Hex(value);
+            MicroBitCommands.WriteSetPinValue(writer, pin, operatingMode == EPinOperatingMode.Digital ? (int)EPinDigitalMode.Out : (int)EPinAnalogMode.Out, value);
             QueueForSend(writer.ToString());
         }
 
@@ -664,9 +661,7 @@ namespace Boku.Input
             _curr.Pins[pin].Value = angle;
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_SET_PIN_SERVO_VALUE);
-            writer.WriteU8Hex(pin);
-            writer.WriteU8Hex(angle);
+            MicroBitCommands.WriteSetPinServoValue(writer, pin, angle);
             QueueForSend(writer.ToString());
         }
 
@@ -691,11 +686,7 @@ namespace Boku.Input
             _curr.Pins[pin].FrequencyMultiplier = multiplier;
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_SET_PIN_PWM_OUT);
-            writer.WriteU8Hex(pin);
-            writer.WriteU16Hex(_curr.Pins[pin].FrequencyHz);
-            writer.WriteU16Hex(_curr.Pins[pin].FrequencyMultiplier);
-            writer.WriteU16Hex(_curr.Pins[pin].DutyCycle);
+            MicroBitCommands.WriteSetPinPwmOut(writer, pin, _curr.Pins[pin].FrequencyHz, _curr.Pins[pin].FrequencyMultiplier, _curr.Pins[pin].DutyCycle);
             QueueForSend(writer.ToString());
         }
 
@@ -719,11 +710,7 @@ namespace Boku.Input
             _curr.Pins[pin].DutyCycle = dutyCycle;
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_SET_PIN_PWM_OUT);
-            writer.WriteU8Hex(pin);
-            writer.WriteU16Hex(_curr.Pins[pin].FrequencyHz);
-            writer.WriteU16Hex(_curr.Pins[pin].FrequencyMultiplier);
-            writer.WriteU16Hex(_curr.Pins[pin].DutyCycle);
+            MicroBitCommands.WriteSetPinPwmOut(writer, pin, _curr.Pins[pin].FrequencyHz, _curr.Pins[pin].FrequencyMultiplier, _curr.Pins[pin].DutyCycle);
             QueueForSend(writer.ToString());
         }
 
@@ -746,15 +733,13 @@ namespace Boku.Input
             _curr.Pins[pin].Value = 0;
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_CONFIG_INPUT_PIN);
-            writer.WriteU8Hex(pin);
             if (operatingMode == EPinOperatingMode.Analog)
             {
-                writer.WriteU8Hex((int)EPinAnalogMode.In);
+                MicroBitCommands.WriteConfigInputPin(writer, pin, (int)EPinAnalogMode.In);
             }
             else
             {
-                writer.WriteU8Hex((int)EPinDigitalMode.In);
+                MicroBitCommands.WriteConfigInputPin(writer, pin, (int)EPinDigitalMode.In);
                 writer.WriteU8Hex((int)pullMode);
             }
             QueueForSend(writer.ToString());
@@ -785,10 +770,7 @@ namespace Boku.Input
             _displayFreeTime = DateTime.Now + TimeSpan.FromMilliseconds(durationMs);
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_SCROLL_IMAGES);
-            writer.WriteU16Hex(delayMs);
-            writer.WriteU8Hex(brightness);
-            writer.WriteU8Hex(images.Count());
+            MicroBitCommands.WriteScrollImages(writer, delayMs, brightness, images.Count());
             foreach (MicroBitImage image in images)
             {
                 string packed = image.Packed;
@@ -819,10 +801,7 @@ namespace Boku.Input
             _displayFreeTime = DateTime.Now + TimeSpan.FromMilliseconds(durationMs);
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_PRINT_IMAGES);
-            writer.WriteU16Hex(durationMs);
-            writer.WriteU8Hex(brightness);
-            writer.WriteU8Hex(images.Count());
+            MicroBitCommands.WritePrintImages(writer, durationMs, brightness, images.Count());
             foreach (MicroBitImage image in images)
             {
                 string packed = image.Packed;
@@ -848,8 +827,7 @@ namespace Boku.Input
             int totalDurationMs = 0;
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_PRINT_DISPLAY_FRAMES);
-            writer.WriteU8Hex(frames.Count());
+            MicroBitCommands.WritePrintDisplayFrames(writer, frames.Count());
             foreach (MicroBitDisplayFrame frame in frames)
             {
                 int durationMs = (int)(frame.Duration * 1000);
@@ -892,10 +870,7 @@ namespace Boku.Input
             _displayFreeTime = DateTime.Now + TimeSpan.FromMilliseconds(durationMs);
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_SCROLL_TEXT);
-            writer.WriteU16Hex(delayMs);
-            writer.WriteU8Hex(brightness);
-            writer.WriteString(str);
+            MicroBitCommands.WriteScrollText(writer, delayMs, brightness, str);
             QueueForSend(writer.ToString());
         }
 
@@ -922,10 +897,7 @@ namespace Boku.Input
             _displayFreeTime = DateTime.Now + TimeSpan.FromMilliseconds(totalDurationMs);
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_PRINT_TEXT);
-            writer.WriteU16Hex(durationMs);
-            writer.WriteU8Hex(brightness);
-            writer.WriteString(str);
+            MicroBitCommands.WritePrintText(writer, durationMs, brightness, str);
             QueueForSend(writer.ToString());
         }
 
@@ -948,10 +920,7 @@ namespace Boku.Input
             }
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_SET_PIXEL);
-            writer.WriteU8Hex(x);
-            writer.WriteU8Hex(y);
-            writer.WriteU8Hex(brightness);
+            MicroBitCommands.WriteSetPixel(writer, x, y, brightness);
             QueueForSend(writer.ToString());
         }
 
@@ -972,16 +941,11 @@ namespace Boku.Input
             _curr.Pins[pin].Busy = true;
 
             MicroBitMessageWriter writer = new MicroBitMessageWriter();
-            writer.WriteChar(Protocol.CMD_PLAY_TONES);
-            writer.WriteU8Hex(pin);
-            writer.WriteU16Hex(durationMs);
-            writer.WriteU8Hex(tones.Length);
+            MicroBitCommands.WritePlayTones(writer, pin, durationMs, tones.Length);
+            // The firmware reads each tone as a word.
             foreach (int tone in tones)
             {
-                if (tone >= 0 && tone < 256)
-                {
-                    writer.WriteU8Hex(tone);
-                }
+                writer.WriteU16Hex(tone);
             }
             QueueForSend(writer.ToString());
         }
@@ -13,6 +13,7 @@ namespace CodeGenUtil
         public static string Heart = @"
             . █ . █ .
             █ █ █ █ █
+            █ █ █ █ █
             . █ █ █ .
             . . █ . .";
         public static string SmallHeart = @"
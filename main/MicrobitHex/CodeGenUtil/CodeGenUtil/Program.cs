@@ -3,16 +3,211 @@
 
 using System;
 using System.Collections.Generic;
+using System.IO;
 using System.Linq;
+using System.Reflection;
 using System.Text;
-using Newtonsoft.Json;
+using System.Text.RegularExpressions;
 
 namespace CodeGenUtil
 {
+    // Generates the firmware's icon and melody tables from Icons.cs and
+    // Melodies.cs into Icons.h and Melodies.h.
+    // Usage: CodeGenUtil [<firmware source dir>]
+    //
+    // Ids are assigned in declaration order, so append new icons and melodies
+    // at the end to keep the ids Kodu already sends stable.
     class Program
     {
-        static void Main(string[] args)
+        // Melody durations are in ticks of a quarter beat at 120 bpm.
+        const int MelodyTickMs = 125;
+        const int DefaultOctave = 4;
+        const int DefaultTicks = 4;
+
+        static readonly string[] NoteNames = { "C", "CSharp", "D", "Eb", "E", "F", "FSharp", "G", "GSharp", "A", "Bb", "B" };
+
+        static int Main(string[] args)
+        {
+            // By default, the firmware sources relative to bin\<Configuration>.
+            string outDir = args.Length > 0 ? args[0] : Path.Combine(AppDomain.CurrentDomain.BaseDirectory, "..", "..", "..", "..", "source");
+            try
+            {
+                File.WriteAllText(Path.Combine(outDir, "Icons.h"), GenerateIcons());
+                File.WriteAllText(Path.Combine(outDir, "Melodies.h"), GenerateMelodies());
+            }
+            catch (Exception e)
+            {
+                Console.Error.WriteLine(e.Message);
+                return 1;
+            }
+            return 0;
+        }
+
+        static IEnumerable<FieldInfo> Fields(Type type)
+        {
+            return type.GetFields(BindingFlags.Public | BindingFlags.Static).OrderBy(f => f.MetadataToken);
+        }
+
+        // "UpRightArrow" -> "UP_RIGHT_ARROW"
+        static string ConstantName(string name)
         {
+            return Regex.Replace(name, "([a-z0-9])([A-Z])", "$1_$2").ToUpperInvariant();
+        }
+
+        static void WriteHeader(StringBuilder sb, string guard, string source)
+        {
+            sb.Append("// Generated by CodeGenUtil from ").Append(source).Append(". Do not edit.\n");
+            sb.Append("\n");
+            sb.Append("#ifndef ").Append(guard).Append("\n");
+            sb.Append("#define ").Append(guard).Append("\n");
+            sb.Append("\n");
+            sb.Append("#include <stdint.h>\n");
+            sb.Append("\n");
+        }
+
+        static void WriteEnum(StringBuilder sb, string type, string prefix, IList<FieldInfo> fields)
+        {
+            sb.Append("enum ").Append(type).Append(" {\n");
+            for (int i = 0; i < fields.Count; ++i)
+            {
+                sb.AppendFormat("    {0}_{1} = {2},\n", prefix, ConstantName(fields[i].Name), i);
+            }
+            sb.AppendFormat("    {0}_COUNT = {1},\n", prefix, fields.Count);
+            sb.Append("};\n");
+            sb.Append("\n");
+        }
+
+        //--------------------------------------------------------------------
+        // Icons
+
+        // Packs an icon into one byte per row, top row first, with bit 4 the
+        // leftmost column: the same layout as a binary-format Image.
+        static byte[] PackIcon(string name, string art)
+        {
+            string[] rows = art.Split('\n').Select(r => r.Trim()).Where(r => r.Length > 0).ToArray();
+            if (rows.Length != 5)
+                throw new FormatException(String.Format("Icon {0} has {1} rows, expected 5", name, rows.Length));
+            byte[] packed = new byte[5];
+            for (int y = 0; y < 5; ++y)
+            {
+                string[] cells = rows[y].Split(new[] { ' ' }, StringSplitOptions.RemoveEmptyEntries);
+                if (cells.Length != 5)
+                    throw new FormatException(String.Format("Icon {0} row {1} has {2} columns, expected 5", name, y, cells.Length));
+                for (int x = 0; x < 5; ++x)
+                {
+                    if (cells[x] == "\u2588")
+                        packed[y] |= (byte)(1 << (4 - x));
+                    else if (cells[x] != ".")
+                        throw new FormatException(String.Format("Icon {0} has unknown pixel '{1}'", name, cells[x]));
+                }
+            }
+            return packed;
+        }
+
+        static string GenerateIcons()
+        {
+            var fields = Fields(typeof(Icons)).ToList();
+            var sb = new StringBuilder();
+            WriteHeader(sb, "ICONS_H", "Icons.cs");
+            WriteEnum(sb, "EIcon", "ICON", fields);
+            sb.Append("// One byte per row, top row first; bit 4 is the leftmost column.\n");
+            sb.Append("static constexpr uint8_t s_icons[ICON_COUNT][5] = {\n");
+            foreach (var field in fields)
+            {
+                byte[] rows = PackIcon(field.Name, (string)field.GetValue(null));
+                sb.AppendFormat("    {{{0}}},  // {1}\n", String.Join(", ", rows.Select(b => String.Format("0x{0:X2}", b))), field.Name);
+            }
+            sb.Append("};\n");
+            sb.Append("\n");
+            sb.Append("#endif  // ICONS_H\n");
+            return sb.ToString();
+        }
+
+        //--------------------------------------------------------------------
+        // Melodies
+
+        // Resolves a note in the micro:bit melody notation, e.g. "c#5:2" or
+        // "r". Octave and duration carry over from the previous note when
+        // left out.
+        static Tuple<int, int> ResolveNote(string melody, string note, ref int octave, ref int ticks)
+        {
+            Match m = Regex.Match(note, "^([a-gr])([#b]?)([0-9]?)(?::([0-9]+))?$");
+            if (!m.Success)
+                throw new FormatException(String.Format("Melody {0} has bad note '{1}'", melody, note));
+            if (m.Groups[3].Length > 0)
+                octave = int.Parse(m.Groups[3].Value);
+            if (m.Groups[4].Length > 0)
+                ticks = int.Parse(m.Groups[4].Value);
+            int durationMs = ticks * MelodyTickMs;
+            if (m.Groups[1].Value == "r")
+                return Tuple.Create((int)Notes.Rest, durationMs);
+
+            int semitone = "c d ef g a b".IndexOf(m.Groups[1].Value[0]);
+            if (m.Groups[2].Value == "#")
+                semitone++;
+            else if (m.Groups[2].Value == "b")
+                semitone--;
+            int noteOctave = octave + (semitone < 0 ? -1 : semitone > 11 ? 1 : 0);
+            semitone = (semitone + 12) % 12;
+
+            // Notes.cs covers octaves 3 to 5; others are scaled from octave 4.
+            Notes frequency;
+            if (Enum.TryParse(NoteNames[semitone] + noteOctave, out frequency))
+                return Tuple.Create((int)frequency, durationMs);
+            frequency = (Notes)Enum.Parse(typeof(Notes), NoteNames[semitone] + DefaultOctave);
+            return Tuple.Create((int)Math.Round((int)frequency * Math.Pow(2, noteOctave - DefaultOctave)), durationMs);
+        }
+
+        static string GenerateMelodies()
+        {
+            var fields = Fields(typeof(Melodies)).ToList();
+            var sb = new StringBuilder();
+            var starts = new List<int>();
+            var notes = new StringBuilder();
+            int noteCount = 0;
+            foreach (var field in fields)
+            {
+                starts.Add(noteCount);
+                notes.AppendFormat("    // {0}\n", field.Name);
+                int octave = DefaultOctave;
+                int ticks = DefaultTicks;
+                var resolved = ((string[])field.GetValue(null)).Select(n => ResolveNote(field.Name, n, ref octave, ref ticks)).ToList();
+                for (int i = 0; i < resolved.Count; i += 6)
+                {
+                    notes.Append("   ");
+                    foreach (var note in resolved.Skip(i).Take(6))
+                        notes.AppendFormat(" {{{0}, {1}}},", note.Item1, note.Item2);
+                    notes.Append("\n");
+                }
+                noteCount += resolved.Count;
+            }
+            starts.Add(noteCount);
+
+            WriteHeader(sb, "MELODIES_H", "Melodies.cs");
+            WriteEnum(sb, "EMelody", "MELODY", fields);
+            sb.Append("// A frequency of 0 is a rest.\n");
+            sb.Append("struct MelodyNote {\n");
+            sb.Append("    uint16_t frequency;\n");
+            sb.Append("    uint16_t durationMs;\n");
+            sb.Append("};\n");
+            sb.Append("\n");
+            sb.Append("static constexpr MelodyNote s_melodyNotes[] = {\n");
+            sb.Append(notes);
+            sb.Append("};\n");
+            sb.Append("\n");
+            sb.Append("// Melody i is s_melodyNotes[s_melodyStarts[i]] up to s_melodyStarts[i + 1].\n");
+            sb.Append("static constexpr uint16_t s_melodyStarts[MELODY_COUNT + 1] = {\n");
+            for (int i = 0; i < starts.Count; i += 10)
+            {
+                sb.Append("   ");
+                foreach (int start in starts.Skip(i).Take(10))
+                    sb.AppendFormat(" {0},", start);
+                sb.Append("\n");
+            }
+            sb.Append("};\n");
+            sb.Append("\n");
+            sb.Append("#endif  // MELODIES_H\n");
+            return sb.ToString();
         }
     }
 }
@@ -0,0 +1,18 @@
+#include <stdio.h>
+
+#include "Benchmark.h"
+#include "Simulator.h"
+
+// Runs the Message codec benchmarks on the host, one JSON object per line.
+
+//----------------------------------------------------------------------------
+static void emit(const char* json) {
+    printf("%s\n", json);
+}
+
+//----------------------------------------------------------------------------
+int main() {
+    sim_use_wall_clock(true);
+    runBenchmarks(emit);
+    return 0;
+}
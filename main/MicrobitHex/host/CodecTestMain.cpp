@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "MicroBit.h"
+#include "Message.h"
+
+// Checks the table-driven hex codec in Message.cpp against the one it
+// replaced, kept below as BaselineCodec.
+//
+//   kodu_codec_test [-runs=N] [-seed=S]   random fields through both; fails
+//                                         on any difference
+//   kodu_codec_test -bench                times both, ns per field
+//
+// Both must write the same bytes and read the same values, and accept and
+// reject the same fields. The one intended difference is what a rejected
+// field leaves behind: the baseline could consume part of a bad field, or
+// write half of a U32 that didn't fit, where Message does neither. So after
+// a rejected field only the verdict is compared.
+
+//============================================================================
+// Baseline
+
+// Message's fields are called across translation units, so for fair timing
+// the baseline's aren't inlined into the benchmark loops either.
+#define BASELINE_FIELD __attribute__((noinline))
+
+// The Message read and write primitives as they were before the lookup
+// tables, copied with only the class around them changed.
+class BaselineCodec {
+   public:
+    BaselineCodec(EWireFormat format, int length) {
+        this->wireFormat = format;
+        this->maxlen = length;
+        this->readptr = this->writeptr = 0;
+    }
+    BaselineCodec(EWireFormat format, const char* chars, int length) {
+        this->wireFormat = format;
+        this->maxlen = this->writeptr = length;
+        this->readptr = 0;
+        memcpy(this->buf, chars, length);
+    }
+
+    const char* charBuffer() const { return this->buf; }
+    int length() const { return this->writeptr; }
+    int bytesRemaining() const { return this->maxlen - this->readptr; }
+    void rewind() { this->readptr = 0; }
+    void clear() { this->readptr = this->writeptr = 0; }
+
+    BASELINE_FIELD bool readU16Hex(uint16_t& value) {
+        uint8_t msb;
+        uint8_t lsb;
+
+        if (!this->readU8HexRaw(msb))
+            return false;
+        if (!this->readU8HexRaw(lsb))
+            return false;
+
+        value = msb << 8;
+        value += lsb;
+
+        return this->consumeSeparator();
+    }
+
+    BASELINE_FIELD bool readU32Hex(uint32_t& value) {
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            uint8_t byte;
+            if (!this->readU8HexRaw(byte))
+                return false;
+            value = (value << 8) | byte;
+        }
+        return this->consumeSeparator();
+    }
+
+    BASELINE_FIELD bool readU8Hex(uint8_t& value) {
+        if (!this->readU8HexRaw(value))
+            return false;
+        return this->consumeSeparator();
+    }
+
+    BASELINE_FIELD bool writeU8Hex(uint8_t value) {
+        if (!this->writeAsciiByte(value))
+            return false;
+        return this->writeSeparator();
+    }
+
+    BASELINE_FIELD bool writeU16Hex(uint16_t value) {
+        if (!this->writeU16HexRaw(value))
+            return false;
+        return this->writeSeparator();
+    }
+
+    BASELINE_FIELD bool writeU32Hex(uint32_t value) {
+        if (!this->writeU16HexRaw(value >> 16))
+            return false;
+        if (!this->writeU16HexRaw(value & 0xFFFF))
+            return false;
+        return this->writeSeparator();
+    }
+
+   private:
+    EWireFormat wireFormat;
+    char buf[128];
+    int maxlen;
+    int readptr;
+    int writeptr;
+
+    static bool FromAscii(char c, uint8_t& value) {
+        // 0-9?
+        if (c >= '0' && c <= '9') {
+            value = c - '0';
+            return true;
+        } else {
+            // A-Z?
+            c &= ~0x20;
+            if (c >= 'A' && c <= 'Z') {
+                value = 10 + c - 'A';
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool readU8HexRaw(uint8_t& value) {
+        if (this->wireFormat == WIRE_FORMAT_BINARY) {
+            if (!this->readable())
+                return false;
+            value = (uint8_t)this->buf[this->readptr++];
+            return true;
+        }
+
+        uint8_t msn;
+        uint8_t lsn;
+
+        if (!this->readAsciiNybble(msn))
+            return false;
+        if (!this->readAsciiNybble(lsn))
+            return false;
+
+        value = msn << 4;
+        value += lsn;
+
+        return true;
+    }
+
+    bool readAsciiNybble(uint8_t& value) {
+        if (!this->readable())
+            return false;
+
+        char c = this->buf[this->readptr];
+
+        if (!FromAscii(c, value))
+            return false;
+
+        ++this->readptr;
+        return true;
+    }
+
+    bool consumeSeparator() {
+        if (this->wireFormat == WIRE_FORMAT_BINARY)
+            return true;  // binary fields are fixed width
+        if (!this->readable())
+            return false;
+        char value = this->buf[this->readptr++];
+        return value == '|';
+    }
+
+    bool writeU16HexRaw(uint16_t value) {
+        if (!this->writable(this->wireFormat == WIRE_FORMAT_BINARY ? 2 : 4))
+            return false;
+        uint8_t hi = (value >> 8) & 0xFF;
+        uint8_t lo = value & 0xFF;
+        if (!writeAsciiByte(hi))
+            return false;
+        if (!writeAsciiByte(lo))
+            return false;
+        return true;
+    }
+
+    bool writeAsciiByte(uint8_t value) {
+        static const char ToAscii[] = {'0', '1', '2', '3', '4', '5', '6', '7',
+                                       '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+        if (this->wireFormat == WIRE_FORMAT_BINARY)
+            return this->writeCharRaw((char)value);
+        if (!this->writable(2))
+            return false;
+        uint8_t hi = (value >> 4) & 0x0F;
+        uint8_t lo = value & 0x0F;
+        if (!this->writeCharRaw(ToAscii[hi]))
+            return false;
+        if (!this->writeCharRaw(ToAscii[lo]))
+            return false;
+        return true;
+    }
+
+    bool writeCharRaw(char value) {
+        if (!this->writable(1))
+            return false;
+        this->buf[this->writeptr++] = value;
+        return true;
+    }
+
+    bool writeSeparator() {
+        if (this->wireFormat == WIRE_FORMAT_BINARY)
+            return true;
+        this->buf[this->writeptr++] = '|';
+        return true;
+    }
+
+    bool readable() const {
+        if (this->readptr >= this->writeptr)
+            return false;
+        return true;
+    }
+
+    bool writable(int length) const {
+        if (this->writeptr + length >= this->maxlen)
+            return false;  // out of space
+        return true;
+    }
+};
+
+//============================================================================
+// Equivalence
+
+enum EField { FIELD_U8, FIELD_U16, FIELD_U32, FIELD_KINDS };
+
+static const char* const s_fieldNames[FIELD_KINDS] = {"U8", "U16", "U32"};
+
+static uint32_t s_seed = 1;
+
+//----------------------------------------------------------------------------
+static uint32_t nextRandom() {
+    s_seed = s_seed * 1103515245u + 12345u;
+    return s_seed >> 8;
+}
+
+//----------------------------------------------------------------------------
+template <typename Codec>
+static bool readField(Codec& codec, EField field, uint32_t& value) {
+    uint8_t u8;
+    uint16_t u16;
+    switch (field) {
+        case FIELD_U8:
+            if (!codec.readU8Hex(u8))
+                return false;
+            value = u8;
+            return true;
+        case FIELD_U16:
+            if (!codec.readU16Hex(u16))
+                return false;
+            value = u16;
+            return true;
+        default:
+            return codec.readU32Hex(value);
+    }
+}
+
+//----------------------------------------------------------------------------
+template <typename Codec>
+static bool writeField(Codec& codec, EField field, uint32_t value) {
+    switch (field) {
+        case FIELD_U8:
+            return codec.writeU8Hex((uint8_t)value);
+        case FIELD_U16:
+            return codec.writeU16Hex((uint16_t)value);
+        default:
+            return codec.writeU32Hex(value);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Input mostly made of well-formed fields, with digits, separators and
+// other bytes mixed in to break some of them.
+static int randomInput(char* dst, int size) {
+    static const char noise[] = "0123456789ABCDEFabcdefGZz|| \x7F\x80\xFF";
+    int length = 0;
+    while (length < size) {
+        if (nextRandom() % 4 == 0) {
+            dst[length++] = noise[nextRandom() % (sizeof(noise) - 1)];
+            continue;
+        }
+        int digits = 2 << (nextRandom() % 3);
+        for (int i = 0; i < digits && length < size; ++i) {
+            dst[length++] = "0123456789ABCDEF"[nextRandom() % 16];
+        }
+        if (length < size) {
+            dst[length++] = '|';
+        }
+    }
+    return nextRandom() % (size + 1);
+}
+
+//----------------------------------------------------------------------------
+static bool compareReads(EWireFormat format) {
+    char input[24];
+    int length = randomInput(input, sizeof(input));
+    Message::setDefaultFormat(format);
+    Message msg(input, length);
+    BaselineCodec baseline(format, input, length);
+    while (true) {
+        EField field = (EField)(nextRandom() % FIELD_KINDS);
+        uint32_t value = 0;
+        uint32_t baselineValue = 0;
+        bool ok = readField(msg, field, value);
+        bool baselineOk = readField(baseline, field, baselineValue);
+        bool same = value == baselineValue && msg.bytesRemaining() == baseline.bytesRemaining();
+        if (ok != baselineOk || (ok && !same)) {
+            printf("FAIL read %s from \"%.*s\": %s %08X, baseline %s %08X\n", s_fieldNames[field], length, input,
+                   ok ? "ok" : "rejected", value, baselineOk ? "ok" : "rejected", baselineValue);
+            return false;
+        }
+        if (!ok) {
+            return true;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+static bool compareWrites(EWireFormat format) {
+    int size = 1 + nextRandom() % 24;
+    Message::setDefaultFormat(format);
+    Message msg(size);
+    BaselineCodec baseline(format, size);
+    while (true) {
+        EField field = (EField)(nextRandom() % FIELD_KINDS);
+        uint32_t value = nextRandom() ^ (nextRandom() << 16);
+        bool ok = writeField(msg, field, value);
+        bool baselineOk = writeField(baseline, field, value);
+        bool same = msg.length() == baseline.length() &&
+                    !memcmp(msg.charBuffer(), baseline.charBuffer(), msg.length());
+        if (ok != baselineOk || (ok && !same)) {
+            printf("FAIL write %s %08X into %d bytes: %s, baseline %s\n", s_fieldNames[field], value, size,
+                   ok ? "ok" : "rejected", baselineOk ? "ok" : "rejected");
+            return false;
+        }
+        if (!ok) {
+            return true;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+static int runEquivalence(int runs) {
+    int failures = 0;
+    for (int run = 0; run < runs && failures < 10; ++run) {
+        EWireFormat format = run % 2 ? WIRE_FORMAT_BINARY : WIRE_FORMAT_ASCII;
+        failures += !compareReads(format);
+        failures += !compareWrites(format);
+    }
+    Message::setDefaultFormat(WIRE_FORMAT_ASCII);
+    printf("%d runs: %s\n", runs, failures ? "FAILED" : "identical");
+    return failures ? 1 : 0;
+}
+
+//============================================================================
+// Timing
+
+#define BENCH_FIELDS 8
+#define BENCH_ITERATIONS 200000
+#define BENCH_MSG_SIZE 120
+
+//----------------------------------------------------------------------------
+template <typename Codec>
+static double timeWrites(Codec& codec, EField field) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i) {
+        codec.clear();
+        for (int f = 0; f < BENCH_FIELDS; ++f) {
+            writeField(codec, field, 0xA55A5AA5 + i);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (BENCH_ITERATIONS * BENCH_FIELDS);
+}
+
+//----------------------------------------------------------------------------
+template <typename Codec>
+static double timeReads(Codec& codec, EField field) {
+    static volatile uint32_t sink;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i) {
+        codec.rewind();
+        uint32_t value;
+        for (int f = 0; f < BENCH_FIELDS; ++f) {
+            readField(codec, field, value);
+            sink = value;
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (BENCH_ITERATIONS * BENCH_FIELDS);
+}
+
+//----------------------------------------------------------------------------
+static int runBench() {
+    const EWireFormat formats[] = {WIRE_FORMAT_ASCII, WIRE_FORMAT_BINARY};
+    for (int f = 0; f < 2; ++f) {
+        Message::setDefaultFormat(formats[f]);
+        for (int field = 0; field < FIELD_KINDS; ++field) {
+            Message msg(BENCH_MSG_SIZE);
+            BaselineCodec baseline(formats[f], BENCH_MSG_SIZE);
+            double write = timeWrites(msg, (EField)field);
+            double baselineWrite = timeWrites(baseline, (EField)field);
+
+            Message src(msg.charBuffer(), msg.length());
+            BaselineCodec baselineSrc(formats[f], msg.charBuffer(), msg.length());
+            double read = timeReads(src, (EField)field);
+            double baselineRead = timeReads(baselineSrc, (EField)field);
+            printf("%s %-3s  write %5.1f ns (baseline %5.1f)  read %5.1f ns (baseline %5.1f)\n",
+                   f ? "binary" : "ascii ", s_fieldNames[field], write, baselineWrite, read, baselineRead);
+        }
+    }
+    Message::setDefaultFormat(WIRE_FORMAT_ASCII);
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    int runs = 100000;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-bench")) {
+            return runBench();
+        } else if (!strncmp(argv[i], "-runs=", 6)) {
+            runs = atoi(argv[i] + 6);
+        } else if (!strncmp(argv[i], "-seed=", 6)) {
+            s_seed = (uint32_t)strtoul(argv[i] + 6, NULL, 0);
+        }
+    }
+    return runEquivalence(runs);
+}
@@ -0,0 +1,39 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Message.h"
+#include "Simulator.h"
+
+// libFuzzer entry point over the receive path: each input is sent as one
+// ASCII line (it may hold more, and binary bytes), and the device runs until
+// dispatch and anything it queued has settled. The sanitizers do the
+// checking; the replies are thrown away.
+
+int koduMain();
+void armReceive();
+
+// Long enough for a command to run and for a short display op it queued to
+// finish, so the queues don't stay full for the next input.
+#define FUZZ_SETTLE_US 200000
+// One character time at 115200 baud.
+#define FUZZ_BYTE_US 87
+
+//----------------------------------------------------------------------------
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static bool booted = false;
+    if (!booted) {
+        sim_boot(koduMain);
+        booted = true;
+    }
+    if (size > 1024) {
+        return 0;
+    }
+    // A previous input may have switched to binary framing.
+    Message::setDefaultFormat(WIRE_FORMAT_ASCII);
+    armReceive();
+    sim_serial_receive(data, (int)size);
+    sim_serial_receive((const uint8_t*)"\n", 1);
+    sim_run_for((uint64_t)(size + 1) * FUZZ_BYTE_US + FUZZ_SETTLE_US);
+    sim_serial_take_output();
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Stand-in for libFuzzer's driver when the compiler doesn't have it:
+//
+//   kodu_fuzz_dispatch [-runs=N] [-seed=S] file-or-dir...
+//
+// Runs every input, then N random mutations of them. There is no coverage
+// feedback, so this is a smoke test rather than a fuzzer.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+typedef std::vector<uint8_t> Input;
+
+//----------------------------------------------------------------------------
+static void loadFile(const std::string& path, std::vector<Input>& inputs) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return;
+    Input input;
+    int c;
+    while ((c = fgetc(f)) != EOF) {
+        input.push_back((uint8_t)c);
+    }
+    fclose(f);
+    inputs.push_back(input);
+}
+
+//----------------------------------------------------------------------------
+static void loadPath(const std::string& path, std::vector<Input>& inputs) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        loadFile(path, inputs);
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            names.push_back(entry->d_name);
+    }
+    closedir(dir);
+    // Sorted, so a seed always replays the same run.
+    std::sort(names.begin(), names.end());
+    for (size_t i = 0; i < names.size(); ++i) {
+        loadFile(path + "/" + names[i], inputs);
+    }
+}
+
+//----------------------------------------------------------------------------
+static void mutate(Input& input, const std::vector<Input>& inputs) {
+    static const uint8_t kInteresting[] = {'|', '\n', 0, '0', 'F', 0xFF};
+    int n = 1 + rand() % 4;
+    while (n--) {
+        size_t at = input.empty() ? 0 : rand() % input.size();
+        switch (rand() % 5) {
+            case 0:
+                if (!input.empty())
+                    input[at] ^= 1 << (rand() % 8);
+                break;
+            case 1:
+                input.insert(input.begin() + at, kInteresting[rand() % sizeof(kInteresting)]);
+                break;
+            case 2:
+                if (!input.empty())
+                    input.erase(input.begin() + at);
+                break;
+            case 3:
+                if (!input.empty())
+                    input[at] = "0123456789ABCDEF"[rand() % 16];
+                break;
+            case 4: {
+                const Input& other = inputs[rand() % inputs.size()];
+                size_t from = other.empty() ? 0 : rand() % other.size();
+                input.insert(input.begin() + at, other.begin() + from, other.end());
+                break;
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    int runs = 0;
+    unsigned seed = 1;
+    std::vector<Input> inputs;
+    for (int i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], "-runs=", 6)) {
+            runs = atoi(argv[i] + 6);
+        } else if (!strncmp(argv[i], "-seed=", 6)) {
+            seed = strtoul(argv[i] + 6, NULL, 10);
+        } else {
+            loadPath(argv[i], inputs);
+        }
+    }
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        LLVMFuzzerTestOneInput(inputs[i].data(), inputs[i].size());
+    }
+    printf("replayed %d inputs\n", (int)inputs.size());
+    if (inputs.empty())
+        inputs.push_back(Input());
+    srand(seed);
+    for (int i = 0; i < runs; ++i) {
+        Input input = inputs[rand() % inputs.size()];
+        mutate(input, inputs);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    printf("ran %d mutations\n", runs);
+    return 0;
+}
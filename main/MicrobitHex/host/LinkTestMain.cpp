@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "MicroBit.h"
+#include "Commands.h"
+#include "Framing.h"
+#include "Simulator.h"
+
+// Checks of the serial link that need more than a script's expected output:
+// sizes and timings measured on the simulated wire.
+//
+//   kodu_link_test <case>
+//
+// Each case boots a fresh device, prints what it measured and exits nonzero
+// on failure.
+
+int koduMain();
+
+// One message as it came off the wire: the bytes up to and including its
+// delimiter, the payload (a binary frame's decoded payload, or the text line
+// without its newline) and the simulated time its last byte was sent.
+struct WireMessage {
+    std::string wire;
+    std::string payload;
+    bool binary;
+    uint64_t timeUs;
+};
+
+static std::string s_pending;
+static std::vector<WireMessage> s_received;
+
+//----------------------------------------------------------------------------
+static void collectOutput() {
+    s_pending += sim_serial_take_output();
+    size_t end;
+    while ((end = s_pending.find_first_of(std::string("\n\0", 2))) != std::string::npos) {
+        WireMessage msg;
+        msg.wire = s_pending.substr(0, end + 1);
+        msg.binary = s_pending[end] == '\0';
+        msg.timeUs = system_timer_current_time_us();
+        if (msg.binary) {
+            std::string frame = msg.wire;
+            uint8_t* payload;
+            int payloadLength;
+            if (frameDecode((uint8_t*)&frame[0], (int)frame.size(), payload, payloadLength)) {
+                msg.payload.assign((const char*)payload, payloadLength);
+            }
+        } else {
+            msg.payload = s_pending.substr(0, end);
+        }
+        s_received.push_back(msg);
+        s_pending.erase(0, end + 1);
+    }
+}
+
+//----------------------------------------------------------------------------
+static void runMs(int ms) {
+    while (ms--) {
+        sim_run_for(1000);
+        collectOutput();
+    }
+}
+
+//----------------------------------------------------------------------------
+static void sendText(const char* line) {
+    std::string bytes = std::string(line) + "\n";
+    sim_serial_receive((const uint8_t*)bytes.data(), (int)bytes.size());
+}
+
+//----------------------------------------------------------------------------
+// Runs until a message whose payload starts with prefix arrives, and
+// returns it, or returns NULL after timeoutMs.
+static const WireMessage* waitFor(const char* prefix, int timeoutMs) {
+    size_t from = s_received.size();
+    for (int ms = 0; ms <= timeoutMs; ++ms) {
+        for (size_t i = from; i < s_received.size(); ++i) {
+            if (!s_received[i].payload.compare(0, strlen(prefix), prefix)) {
+                return &s_received[i];
+            }
+        }
+        from = s_received.size();
+        runMs(1);
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+static bool check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+    return ok;
+}
+
+//============================================================================
+// Cases
+
+//----------------------------------------------------------------------------
+// The same sampled state, streamed in text and then in binary, must take
+// less than half the bytes in binary.
+static bool testSampledStateSize() {
+    sendText("N|0A|01|00|");
+    const WireMessage* text = waitFor("c", 500);
+    if (!check(text != NULL, "text sampled state")) {
+        return false;
+    }
+    size_t textBytes = text->wire.size();
+
+    sendText("P|01|");
+    if (!check(waitFor("p|04|01|", 100) != NULL, "binary negotiated")) {
+        return false;
+    }
+    const WireMessage* binary = waitFor("c", 500);
+    if (!check(binary != NULL && binary->binary, "binary sampled state")) {
+        return false;
+    }
+    size_t binaryBytes = binary->wire.size();
+    printf("sampled state: %d bytes text, %d bytes binary\n", (int)textBytes, (int)binaryBytes);
+    return check(2 * binaryBytes <= textBytes, "binary at most half of text");
+}
+
+//----------------------------------------------------------------------------
+// A device left in binary comes back to text after a bad frame, and on S.
+static bool testFormatFallback() {
+    sendText("P|01|");
+    if (!check(waitFor("p|04|01|", 100) != NULL, "binary negotiated")) {
+        return false;
+    }
+    // A host that restarted in text, resyncing with a NUL before its S.
+    const char resync[] = "P|\n\0S|\n";
+    sim_serial_receive((const uint8_t*)resync, sizeof(resync) - 1);
+    const WireMessage* error = waitFor("m", 100);
+    if (!check(error != NULL && error->binary && error->payload.find("ERR_FRAME") != std::string::npos,
+               "bad frame reported in binary")) {
+        return false;
+    }
+    const WireMessage* reply = waitFor("p|04|", 100);
+    if (!check(reply != NULL && !reply->binary, "S answered in text")) {
+        return false;
+    }
+
+    // S alone, sent as a binary frame, also goes back to text.
+    sendText("P|01|");
+    if (!check(waitFor("p|04|01|", 100) != NULL, "binary negotiated again")) {
+        return false;
+    }
+    uint8_t frame[16];
+    frame[FRAME_HEADER_SIZE] = 'S';
+    int length = frameEncode(frame, 1);
+    sim_serial_receive(frame, length);
+    reply = waitFor("p|04|", 100);
+    if (!check(reply != NULL && !reply->binary, "binary S answered in text")) {
+        return false;
+    }
+    sendText("P|");
+    return check(waitFor("p|04|", 100) != NULL, "text accepted after S");
+}
+
+//----------------------------------------------------------------------------
+// With sampled state streaming at the highest rate, a button press must
+// still reach the wire within BUTTON_LATENCY_BOUND_MS, wherever in the
+// telemetry cycle it lands.
+#define BUTTON_LATENCY_BOUND_MS 8
+#define BUTTON_PRESSES 40
+
+static bool testButtonLatency() {
+    sendText("N|64|01|00|");
+    // The first frame waits out the default period.
+    if (!check(waitFor("c", 200) != NULL, "telemetry streaming")) {
+        return false;
+    }
+    uint64_t worstUs = 0;
+    for (int i = 0; i < BUTTON_PRESSES; ++i) {
+        // Step the press through the 10ms telemetry period.
+        sim_run_for(1000 + i * 1000 / 4 + (i % 4) * 97);
+        collectOutput();
+        uint64_t pressUs = system_timer_current_time_us();
+        sim_set_button(i % 2, true);
+        const WireMessage* event = waitFor("a", 100);
+        if (!event) {
+            return check(false, "button event sent");
+        }
+        uint64_t latencyUs = event->timeUs - pressUs;
+        if (latencyUs > worstUs) {
+            worstUs = latencyUs;
+        }
+        sim_set_button(i % 2, false);
+        runMs(5);
+    }
+    printf("button to wire: worst %d us over %d presses\n", (int)worstUs, BUTTON_PRESSES);
+    return check(worstUs <= BUTTON_LATENCY_BOUND_MS * 1000ULL, "button latency within bound");
+}
+
+//----------------------------------------------------------------------------
+// CMD_BATCH against one line per command. Text lines are limited to 128
+// bytes, which a batch of this many pixels and a ping just fits.
+#define BATCH_PIXELS 6
+
+struct BatchCost {
+    int bytes;
+    uint32_t wakeups;
+    uint64_t us;
+};
+
+// Pixel commands, then a ping whose reply shows when all have run, as
+// payloads in the current wire format.
+static std::vector<std::string> encodeBatchCommands() {
+    std::vector<std::string> commands;
+    for (int i = 0; i < BATCH_PIXELS; ++i) {
+        Message msg(32);
+        CmdSetPixel pixel = {(uint8_t)(i % 5), (uint8_t)(i / 5), 0xFF};
+        encodeCommand(msg, pixel);
+        commands.push_back(std::string(msg.charBuffer(), msg.length()));
+    }
+    Message msg(32);
+    CmdPing ping;
+    encodeCommand(msg, ping);
+    commands.push_back(std::string(msg.charBuffer(), msg.length()));
+    return commands;
+}
+
+//----------------------------------------------------------------------------
+static std::string toWire(const std::string& payload, bool binary) {
+    if (!binary) {
+        return payload + "\n";
+    }
+    uint8_t block[FRAME_MAX_PAYLOAD + FRAME_OVERHEAD];
+    memcpy(block + FRAME_HEADER_SIZE, payload.data(), payload.size());
+    int length = frameEncode(block, (int)payload.size());
+    return std::string((const char*)block, length);
+}
+
+//----------------------------------------------------------------------------
+// Sends wire all at once and measures until the ping reply arrives.
+static bool measureBatchCost(const std::string& wire, BatchCost& cost) {
+    uint32_t runs = sim_handler_runs(MICROBIT_ID_SERIAL);
+    uint64_t startUs = system_timer_current_time_us();
+    sim_serial_receive((const uint8_t*)wire.data(), (int)wire.size());
+    const WireMessage* reply = waitFor("p", 100);
+    if (!reply) {
+        return false;
+    }
+    cost.bytes = (int)wire.size();
+    cost.wakeups = sim_handler_runs(MICROBIT_ID_SERIAL) - runs;
+    cost.us = reply->timeUs - startUs;
+    return true;
+}
+
+//----------------------------------------------------------------------------
+static bool compareBatchCost(bool binary) {
+    const char* format = binary ? "binary" : "text";
+    std::vector<std::string> commands = encodeBatchCommands();
+    std::string separate;
+    Message batch(128);
+    CmdBatch header = {(uint8_t)commands.size()};
+    encodeCommand(batch, header);
+    for (size_t i = 0; i < commands.size(); ++i) {
+        separate += toWire(commands[i], binary);
+        batch.writeStringField(commands[i].data(), (int)commands[i].size());
+    }
+    std::string batched = toWire(std::string(batch.charBuffer(), batch.length()), binary);
+
+    BatchCost one;
+    BatchCost many;
+    if (!check(measureBatchCost(separate, one), "separate commands run") ||
+        !check(measureBatchCost(batched, many), "batched commands run")) {
+        return false;
+    }
+    int count = (int)commands.size();
+    printf("%s, per command: %.1f bytes, %.2f wakeups, %d us one per line; %.1f bytes, %.2f wakeups, %d us batched\n",
+           format, (double)one.bytes / count, (double)one.wakeups / count, (int)(one.us / count),
+           (double)many.bytes / count, (double)many.wakeups / count, (int)(many.us / count));
+    if (!check(one.wakeups == (uint32_t)count && many.wakeups == 1, "one wakeup per line")) {
+        return false;
+    }
+    // Frames cost more per command than batch entries; text lines less.
+    return !binary || check(many.bytes < one.bytes, "binary batch smaller");
+}
+
+//----------------------------------------------------------------------------
+// The same commands as separate lines and as one CMD_BATCH, in both wire
+// formats. A batch always saves wakeups; whether it saves bytes depends on
+// the format.
+static bool testBatchCost() {
+    sendText("N|00|00|00|");
+    runMs(10);
+    if (!compareBatchCost(false)) {
+        return false;
+    }
+    sendText("P|01|");
+    if (!check(waitFor("p|04|01|", 100) != NULL, "binary negotiated")) {
+        return false;
+    }
+    return compareBatchCost(true);
+}
+
+//----------------------------------------------------------------------------
+static std::string displayPixels() {
+    std::string pixels;
+    for (int i = 0; i < 25; ++i) {
+        pixels += (char)sim_display_pixel(i % 5, i / 5);
+    }
+    return pixels;
+}
+
+//----------------------------------------------------------------------------
+// Compass calibration takes the display from the display worker and gives
+// back what was showing, with anything drawn directly meanwhile.
+static bool testCalibrationDisplay() {
+    sendText("N|00|00|00|");
+    sendText("R|00|80|");
+    runMs(20);
+    std::string heart = displayPixels();
+
+    // A long text running and an icon waiting when calibration starts.
+    sendText("D|2710|FF|01x|");
+    sendText("R|02|FF|");
+    runMs(20);
+    sendText("R|00|80|");
+    runMs(20);
+    sendText("Z|01|01|");
+    runMs(100);
+    std::string full(25, (char)255);
+    if (!check(displayPixels() == full, "calibration has the display")) {
+        return false;
+    }
+    // Queued while calibrating: waits for the display.
+    sendText("R|02|FF|");
+    // Drawn directly while calibrating: shows afterwards.
+    sendText("I|00|00|00|");
+    runMs(100);
+    if (!check(displayPixels() == full, "display worker held")) {
+        return false;
+    }
+    runMs(1000);
+    if (!check(sim_display_brightness() == 0xFF && displayPixels() != full && displayPixels() != heart,
+               "queued icon shown after calibration")) {
+        return false;
+    }
+
+    // Calibrating again with nothing queued restores the display as it was.
+    sendText("R|00|80|");
+    runMs(20);
+    sendText("Z|01|01|");
+    runMs(100);
+    sendText("I|00|00|00|");
+    runMs(1100);
+    heart[0] = 0;
+    return check(displayPixels() == heart && sim_display_brightness() == 0x80, "display restored");
+}
+
+//============================================================================
+
+struct LinkTest {
+    const char* name;
+    bool (*run)();
+};
+
+static const LinkTest s_tests[] = {
+    {"sampled_state_size", testSampledStateSize},
+    {"format_fallback", testFormatFallback},
+    {"button_latency", testButtonLatency},
+    {"batch_cost", testBatchCost},
+    {"calibration_display", testCalibrationDisplay},
+};
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    for (unsigned i = 0; i < sizeof(s_tests) / sizeof(s_tests[0]); ++i) {
+        if (argc > 1 && !strcmp(argv[1], s_tests[i].name)) {
+            sim_boot(koduMain);
+            return s_tests[i].run() ? 0 : 1;
+        }
+    }
+    fprintf(stderr, "usage: kodu_link_test <case>\ncases:");
+    for (unsigned i = 0; i < sizeof(s_tests) / sizeof(s_tests[0]); ++i) {
+        fprintf(stderr, " %s", s_tests[i].name);
+    }
+    fprintf(stderr, "\n");
+    return 2;
+}
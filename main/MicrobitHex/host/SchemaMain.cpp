@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "MicroBit.h"
+#include "Commands.h"
+
+// Checks and exports the command fields declared in Commands.h.
+//
+//   kodu_schema               encodes and decodes every command in both wire
+//                             formats, and fails if any doesn't round-trip
+//   kodu_schema -cs           prints Kodu's C# writers, MicroBitCommands.cs
+//   kodu_schema -check=PATH   fails if PATH isn't what -cs prints
+//
+// The C# writers only cover each command's fixed fields; callers write any
+// repeated or optional part after them.
+
+//============================================================================
+// Round trip
+
+// Fills each field with values that vary by field and pass.
+struct FieldFiller {
+    uint32_t seed;
+
+    bool operator()(const char*, uint8_t& value) {
+        value = (uint8_t)this->next();
+        return true;
+    }
+    bool operator()(const char*, uint16_t& value) {
+        value = (uint16_t)this->next();
+        return true;
+    }
+    bool operator()(const char*, uint32_t& value) {
+        value = this->next();
+        return true;
+    }
+    bool operator()(const char*, ManagedString& value) {
+        // Includes the separator, which a String may hold.
+        const char text[] = "Kodu|0";
+        value = ManagedString(text, this->next() % sizeof(text));
+        return true;
+    }
+
+    uint32_t next() {
+        this->seed = this->seed * 1103515245u + 12345u;
+        return this->seed;
+    }
+};
+
+//----------------------------------------------------------------------------
+template <typename Command>
+static bool roundTrip(EWireFormat format, uint32_t seed) {
+    Message::setDefaultFormat(format);
+    Command sent;
+    FieldFiller filler = {seed};
+    sent.visit(filler);
+    Message encoded(128);
+    if (!encodeCommand(encoded, sent)) {
+        printf("FAIL %s: encode\n", Command::name());
+        return false;
+    }
+
+    Command received;
+    int decoded;
+    Message msg(encoded.charBuffer(), encoded.length());
+    if (!decodeCommand(msg, received, &decoded) || decoded != Command::Fields::count || msg.bytesRemaining()) {
+        printf("FAIL %s: decoded %d of %d fields\n", Command::name(), decoded, Command::Fields::count);
+        return false;
+    }
+    Message reencoded(128);
+    encodeCommand(reencoded, received);
+    if (reencoded.length() != encoded.length() ||
+        memcmp(reencoded.charBuffer(), encoded.charBuffer(), encoded.length())) {
+        printf("FAIL %s: decoded fields differ\n", Command::name());
+        return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+static int runRoundTrips() {
+    int failures = 0;
+    const EWireFormat formats[] = {WIRE_FORMAT_ASCII, WIRE_FORMAT_BINARY};
+    for (int f = 0; f < 2; ++f) {
+        for (uint32_t seed = 1; seed <= 100; ++seed) {
+#define ROUND_TRIP_COMMAND(ID, Name, op) failures += !roundTrip<Cmd##Name>(formats[f], seed);
+            KODU_COMMANDS(ROUND_TRIP_COMMAND)
+#undef ROUND_TRIP_COMMAND
+        }
+    }
+    Message::setDefaultFormat(WIRE_FORMAT_ASCII);
+    printf("%s\n", failures ? "round trip FAILED" : "round trip OK");
+    return failures ? 1 : 0;
+}
+
+//============================================================================
+// C# writers
+
+// Collects a command's parameter list and the writer calls for its body.
+struct CSharpEmitter {
+    std::string params;
+    std::string body;
+
+    bool operator()(const char* name, const uint8_t&) { return this->field("int", name, "WriteU8Hex"); }
+    bool operator()(const char* name, const uint16_t&) { return this->field("int", name, "WriteU16Hex"); }
+    bool operator()(const char* name, const uint32_t&) { return this->field("uint", name, "WriteU32Hex"); }
+    bool operator()(const char* name, const ManagedString&) { return this->field("string", name, "WriteString"); }
+
+    bool field(const char* type, const char* name, const char* write) {
+        this->params += std::string(", ") + type + " " + name;
+        this->body += std::string("            writer.") + write + "(" + name + ");\n";
+        return true;
+    }
+};
+
+//----------------------------------------------------------------------------
+template <typename Command>
+static void emitCSharpWriter(std::string& out) {
+    Command cmd;
+    CSharpEmitter emitter;
+    static_cast<const Command&>(cmd).visit(emitter);
+    char opcode[8];
+    snprintf(opcode, sizeof(opcode), "'%c'", Command::opcode);
+    out += std::string("\n        public static void Write") + Command::name() + "(MicroBitMessageWriter writer" +
+           emitter.params + ")\n";
+    out += "        {\n";
+    out += std::string("            writer.WriteChar(") + opcode + ");\n";
+    out += emitter.body;
+    out += "        }\n";
+}
+
+//----------------------------------------------------------------------------
+static std::string generateCSharp() {
+    std::string out;
+    out += "// Copyright (c) Microsoft Corporation.\n";
+    out += "// Licensed under the MIT license.\n";
+    out += "\n";
+    out += "// Generated by kodu_schema -cs from MicrobitHex/source/Commands.h. Do not edit.\n";
+    out += "\n";
+    out += "namespace Boku.Input\n";
+    out += "{\n";
+    out += "    /// <summary>\n";
+    out += "    /// Writes each micro:bit command's opcode and fixed fields, in the order the\n";
+    out += "    /// firmware reads them. Any repeated or optional part is written after.\n";
+    out += "    /// </summary>\n";
+    out += "    public static class MicroBitCommands\n";
+    out += "    {";
+#define EMIT_CSHARP_WRITER(ID, Name, op) emitCSharpWriter<Cmd##Name>(out);
+    KODU_COMMANDS(EMIT_CSHARP_WRITER)
+#undef EMIT_CSHARP_WRITER
+    out += "    }\n";
+    out += "}\n";
+    return out;
+}
+
+//----------------------------------------------------------------------------
+static int checkCSharp(const char* path) {
+    std::string expected = generateCSharp();
+    std::string actual;
+    FILE* file = fopen(path, "rb");
+    if (file) {
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+            actual.append(buf, n);
+        }
+        fclose(file);
+    }
+    if (actual != expected) {
+        printf("%s is out of date with Commands.h; regenerate it with kodu_schema -cs\n", path);
+        return 1;
+    }
+    printf("%s is up to date\n", path);
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "-cs")) {
+        fputs(generateCSharp().c_str(), stdout);
+        return 0;
+    }
+    if (argc > 1 && !strncmp(argv[1], "-check=", 7)) {
+        return checkCSharp(argv[1] + 7);
+    }
+    return runRoundTrips();
+}
@@ -0,0 +1,151 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "MicroBit.h"
+#include "Simulator.h"
+
+// Runs the firmware against a script of host messages and prints what it
+// sends back.
+//
+//   kodu_sim [-ms=N] [-expect=PATH] [script]
+//
+// Each script line is sent as one message, then the device runs for N ms of
+// simulated time (default 50). Output lines and binary frames are printed
+// with the simulated time they were complete at; bytes outside printable
+// ASCII are shown as \xNN. Script lines may use the same escapes, and a line
+// ending in \x00 is sent as a binary frame, without a newline.
+//
+// With -expect, the output must match PATH exactly, or kodu_sim fails and
+// shows the first line that differs.
+
+int koduMain();
+
+//----------------------------------------------------------------------------
+static void printOutput(std::string& pending, std::string& printed) {
+    pending += sim_serial_take_output();
+    size_t end;
+    while ((end = pending.find_first_of(std::string("\n\0", 2))) != std::string::npos) {
+        char text[16];
+        snprintf(text, sizeof(text), "%10.3f ", system_timer_current_time_us() / 1000.0);
+        std::string line = text;
+        for (size_t i = 0; i < end; ++i) {
+            unsigned char c = pending[i];
+            if (c >= 0x20 && c < 0x7F && c != '\\') {
+                line += (char)c;
+            } else {
+                snprintf(text, sizeof(text), "\\x%02X", c);
+                line += text;
+            }
+        }
+        line += '\n';
+        fputs(line.c_str(), stdout);
+        printed += line;
+        pending.erase(0, end + 1);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Replaces each \xNN in line with its byte.
+static std::string unescape(const std::string& line) {
+    std::string bytes;
+    for (size_t i = 0; i < line.size(); ++i) {
+        if (line[i] == '\\' && i + 3 < line.size() && line[i + 1] == 'x' && isxdigit(line[i + 2]) &&
+            isxdigit(line[i + 3])) {
+            bytes += (char)strtol(line.substr(i + 2, 2).c_str(), NULL, 16);
+            i += 3;
+        } else {
+            bytes += line[i];
+        }
+    }
+    return bytes;
+}
+
+//----------------------------------------------------------------------------
+static bool readFile(const char* path, std::string& contents) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        contents.append(buf, n);
+    }
+    fclose(file);
+    return true;
+}
+
+//----------------------------------------------------------------------------
+static int compareOutput(const char* path, const std::string& printed) {
+    std::string expected;
+    if (!readFile(path, expected)) {
+        fprintf(stderr, "kodu_sim: can't open %s\n", path);
+        return 1;
+    }
+    if (printed == expected) {
+        return 0;
+    }
+    // Both end each line with a newline, so the first difference is on the
+    // line after the last newline they share.
+    size_t start = 0;
+    int lineNumber = 1;
+    for (size_t i = 0; i < printed.size() && i < expected.size() && printed[i] == expected[i]; ++i) {
+        if (printed[i] == '\n') {
+            start = i + 1;
+            ++lineNumber;
+        }
+    }
+    std::string want = start < expected.size() ? expected.substr(start, expected.find('\n', start) - start) : "(end)";
+    std::string got = start < printed.size() ? printed.substr(start, printed.find('\n', start) - start) : "(end)";
+    fprintf(stderr, "kodu_sim: output differs from %s at line %d\n  expected: %s\n  got:      %s\n", path,
+            lineNumber, want.c_str(), got.c_str());
+    return 1;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    int stepMs = 50;
+    const char* expectPath = NULL;
+    FILE* script = stdin;
+    for (int i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], "-ms=", 4)) {
+            stepMs = atoi(argv[i] + 4);
+        } else if (!strncmp(argv[i], "-expect=", 8)) {
+            expectPath = argv[i] + 8;
+        } else if (!(script = fopen(argv[i], "rb"))) {
+            fprintf(stderr, "kodu_sim: can't open %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    sim_boot(koduMain);
+    std::string pending;
+    std::string printed;
+    std::string line;
+    int c = 0;
+    while (c != EOF) {
+        // Read by hand rather than with fgets(): binary frames hold NULs.
+        line.clear();
+        while ((c = fgetc(script)) != EOF && c != '\n') {
+            line += (char)c;
+        }
+        if (line.empty() && c == EOF) {
+            break;
+        }
+        line = unescape(line);
+        if (line.empty() || line[line.size() - 1] != '\0') {
+            line += '\n';
+        }
+        sim_serial_receive((const uint8_t*)line.data(), (int)line.size());
+        for (int ms = 0; ms < stepMs; ++ms) {
+            sim_run_for(1000);
+            printOutput(pending, printed);
+        }
+    }
+    printOutput(pending, printed);
+    return expectPath ? compareOutput(expectPath, printed) : 0;
+}
@@ -0,0 +1,308 @@
+#ifndef MICROBIT_H
+#define MICROBIT_H
+
+// Simulated stand-in for the parts of the micro:bit DAL (v2.1.1) the
+// firmware uses, so the unmodified sources build and run on a PC. Names,
+// signatures and constants follow the DAL; behavior is only as deep as the
+// firmware needs. Simulator.h drives it from the host side.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+//============================================================================
+// Error codes, ids and events
+
+#define MICROBIT_OK 0
+#define MICROBIT_INVALID_PARAMETER -1001
+#define MICROBIT_NO_DATA -1012
+
+#define MICROBIT_ID_ANY 0
+#define MICROBIT_EVT_ANY 0
+
+#define MICROBIT_ID_BUTTON_A 1
+#define MICROBIT_ID_BUTTON_B 2
+#define MICROBIT_ID_ACCELEROMETER 4
+#define MICROBIT_ID_COMPASS 5
+#define MICROBIT_ID_DISPLAY 6
+#define MICROBIT_ID_IO_P0 7
+#define MICROBIT_ID_IO_P1 8
+#define MICROBIT_ID_IO_P2 9
+#define MICROBIT_ID_GESTURE 27
+#define MICROBIT_ID_SERIAL 32
+
+#define MICROBIT_BUTTON_EVT_DOWN 1
+#define MICROBIT_BUTTON_EVT_UP 2
+#define MICROBIT_BUTTON_EVT_CLICK 3
+#define MICROBIT_BUTTON_SIMPLE_EVENTS 0
+#define MICROBIT_BUTTON_ALL_EVENTS 1
+
+#define MICROBIT_ACCELEROMETER_EVT_DATA_UPDATE 1
+
+#define MICROBIT_SERIAL_EVT_DELIM_MATCH 1
+
+#define MICROBIT_PIN_EVT_RISE 2
+#define MICROBIT_PIN_EVT_FALL 3
+#define MICROBIT_PIN_EVENT_NONE 0
+#define MICROBIT_PIN_EVENT_ON_EDGE 1
+#define MICROBIT_PIN_MAX_OUTPUT 1023
+
+#define IO_STATUS_DIGITAL_IN 0x01
+#define IO_STATUS_DIGITAL_OUT 0x02
+#define IO_STATUS_ANALOG_IN 0x04
+#define IO_STATUS_ANALOG_OUT 0x08
+#define IO_STATUS_EVENT_ON_EDGE 0x20
+
+#define MICROBIT_IO_PINS 20
+
+#define MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY 0x0002
+#define MESSAGE_BUS_LISTENER_NONBLOCKING 0x0008
+#define MESSAGE_BUS_LISTENER_URGENT 0x0010
+#define MESSAGE_BUS_LISTENER_IMMEDIATE (MESSAGE_BUS_LISTENER_NONBLOCKING | MESSAGE_BUS_LISTENER_URGENT)
+#define MESSAGE_BUS_LISTENER_DEFAULT_FLAGS MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY
+
+#define MICROBIT_STORAGE_KEY_SIZE 16
+#define MICROBIT_STORAGE_VALUE_SIZE 32
+#define MICROBIT_STORAGE_ENTRIES 21
+
+enum PinMode {
+    PullNone = 0,
+    PullDown = 1,
+    PullUp = 3,
+};
+
+enum MicroBitSerialMode {
+    ASYNC = 0,
+    SYNC_SPINWAIT = 1,
+    SYNC_SLEEP = 2,
+};
+
+enum DisplayMode {
+    DISPLAY_MODE_BLACK_AND_WHITE = 0,
+    DISPLAY_MODE_GREYSCALE = 1,
+};
+
+enum MicroBitEventLaunchMode {
+    CREATE_ONLY = 0,
+    CREATE_AND_FIRE = 1,
+};
+
+//============================================================================
+// Time and fibers
+
+struct Fiber;
+
+unsigned long system_timer_current_time();
+uint64_t system_timer_current_time_us();
+
+void release_fiber();
+Fiber* create_fiber(void (*entry)(), void (*completion)() = release_fiber);
+void fiber_sleep(unsigned long ms);
+int fiber_wait_for_event(uint16_t id, uint16_t value);
+
+// mbed's periodic timer interrupt. The callback runs outside any fiber.
+class Ticker {
+   public:
+    Ticker();
+    ~Ticker();
+    void attach_us(void (*callback)(), uint32_t us);
+    void detach();
+
+    void (*callback)();
+    uint32_t periodUs;
+    uint64_t dueUs;
+};
+
+//============================================================================
+// Values
+
+class ManagedString {
+   public:
+    ManagedString();
+    ManagedString(const char* str);
+    ManagedString(const char* str, const int16_t length);
+    ManagedString(const char value);
+    ManagedString(const int value);
+
+    ManagedString operator+(const ManagedString& rhs) const;
+    bool operator==(const ManagedString& rhs) const;
+    const char* toCharArray() const;
+    int16_t length() const;
+    char charAt(int16_t index) const;
+
+   private:
+    std::string chars;
+};
+
+class MicroBitImage {
+   public:
+    MicroBitImage();
+    MicroBitImage(const int16_t x, const int16_t y);
+    MicroBitImage(const int16_t x, const int16_t y, const uint8_t* bitmap);
+
+    MicroBitImage clone() const;
+    void clear();
+    int setPixelValue(int16_t x, int16_t y, uint8_t value);
+    int getPixelValue(int16_t x, int16_t y) const;
+    int getWidth() const;
+    int getHeight() const;
+    uint8_t* getBitmap();
+
+   private:
+    int16_t width;
+    int16_t height;
+    std::vector<uint8_t> pixels;
+};
+
+class MicroBitEvent {
+   public:
+    uint16_t source;
+    uint16_t value;
+    uint64_t timestamp;  // microseconds since boot
+
+    MicroBitEvent();
+    MicroBitEvent(uint16_t source, uint16_t value, MicroBitEventLaunchMode mode = CREATE_AND_FIRE);
+    void fire();
+};
+
+//============================================================================
+// Components
+
+class MicroBitMessageBus {
+   public:
+    int listen(uint16_t id, uint16_t value, void (*handler)(MicroBitEvent),
+               uint16_t flags = MESSAGE_BUS_LISTENER_DEFAULT_FLAGS);
+};
+
+class MicroBitSerial {
+   public:
+    MicroBitSerial();
+    void baud(int baudrate);
+    int setRxBufferSize(uint8_t size);
+    int setTxBufferSize(uint8_t size);
+    int getTxBufferSize();
+    int txBufferedSize();
+    int eventOn(ManagedString delimiters, MicroBitSerialMode mode = ASYNC);
+    int read(MicroBitSerialMode mode = SYNC_SLEEP);
+    int send(uint8_t* buffer, int length, MicroBitSerialMode mode = SYNC_SLEEP);
+};
+
+class MicroBitDisplay {
+   public:
+    MicroBitImage image;
+
+    MicroBitDisplay();
+    void enable();
+    void setDisplayMode(DisplayMode mode);
+    void setBrightness(int brightness);
+    int getBrightness() const;
+    int print(MicroBitImage i, int x = 0, int y = 0, int alpha = 0, int delay = 0);
+    int print(ManagedString s, int delay = 400);
+    int scroll(MicroBitImage image, int delay = 120, int stride = -1);
+    int scroll(ManagedString s, int delay = 120);
+    int scrollAsync(ManagedString s, int delay = 120);
+    void stopAnimation();
+
+   private:
+    int brightness;
+    uint32_t animation;  // counts stopAnimation() calls
+
+    void animate(int steps, int delay);
+};
+
+class MicroBitPin {
+   public:
+    MicroBitPin();
+    int setDigitalValue(int value);
+    int getDigitalValue();
+    int getDigitalValue(PinMode pull);
+    int setAnalogValue(int value);
+    int getAnalogValue();
+    int setAnalogPeriodUs(int period);
+    int setServoValue(int value);
+    int setPull(PinMode pull);
+    int eventOn(int eventType);
+    int isInput();
+    int isAnalog();
+
+    uint16_t id;
+    uint8_t status;
+    PinMode pullMode;
+    int level;  // as driven by the simulator, 0-1023
+};
+
+class MicroBitIO {
+   public:
+    MicroBitIO();
+    MicroBitPin pin[MICROBIT_IO_PINS];
+};
+
+class MicroBitButton {
+   public:
+    void setEventConfiguration(int config);
+};
+
+class MicroBitAccelerometer {
+   public:
+    int setRange(int range);
+    int setPeriod(int period);
+    int getPeriod();
+    int configure();
+    int getX();
+    int getY();
+    int getZ();
+};
+
+struct CompassSample {
+    int x;
+    int y;
+    int z;
+};
+
+struct CompassCalibration {
+    CompassSample centre;
+    CompassSample scale;
+    int radius;
+};
+
+class MicroBitCompass {
+   public:
+    int heading();
+    int calibrate();
+    int isCalibrated();
+    void setCalibration(CompassCalibration calibration);
+    CompassCalibration getCalibration();
+    void clearCalibration();
+};
+
+struct KeyValuePair {
+    uint8_t key[MICROBIT_STORAGE_KEY_SIZE];
+    uint8_t value[MICROBIT_STORAGE_VALUE_SIZE];
+};
+
+class MicroBitStorage {
+   public:
+    int put(const char* key, uint8_t* data, int dataSize);
+    KeyValuePair* get(const char* key);
+    int remove(const char* key);
+};
+
+class MicroBit {
+   public:
+    MicroBitMessageBus messageBus;
+    MicroBitSerial serial;
+    MicroBitDisplay display;
+    MicroBitButton buttonA;
+    MicroBitButton buttonB;
+    MicroBitAccelerometer accelerometer;
+    MicroBitCompass compass;
+    MicroBitStorage storage;
+    MicroBitIO io;
+
+    void init();
+};
+
+#endif  // MICROBIT_H
@@ -0,0 +1,8 @@
+#ifndef MICROBIT_COMPAT_H
+#define MICROBIT_COMPAT_H
+
+// The firmware includes this for the DAL's portability helpers, none of
+// which it uses yet.
+#include "MicroBit.h"
+
+#endif  // MICROBIT_COMPAT_H
@@ -0,0 +1,1104 @@
+#include "MicroBit.h"
+#include "Simulator.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include <algorithm>
+#include <deque>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define SIM_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SIM_ASAN 1
+#endif
+#endif
+
+#if SIM_ASAN
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+//============================================================================
+
+// Sanitizers inflate stack frames, so fibers get far more than on the device.
+#define SIM_FIBER_STACK_SIZE (256 * 1024)
+#define SIM_DEFAULT_BAUD 115200
+// The DAL's serial buffers start at 20 bytes.
+#define SIM_SERIAL_DEFAULT_BUFFER_SIZE 20
+#define SIM_ACCEL_DEFAULT_PERIOD_MS 20
+#define SIM_CALIBRATION_MS 1000
+// How often a blocking animation checks whether it was stopped.
+#define SIM_ANIMATION_SLICE_MS 10
+
+struct Listener {
+    uint16_t id;
+    uint16_t value;
+    void (*handler)(MicroBitEvent);
+    uint16_t flags;
+    bool busy;
+    std::deque<MicroBitEvent> queued;
+    uint32_t runs;
+};
+
+struct Fiber {
+    ucontext_t context;
+    void* stack;
+    void* fakeStack;
+    void (*entry)();
+    void (*completion)();
+    Listener* listener;  // set for a fiber running a listener's events
+    MicroBitEvent event;
+    uint64_t wakeUs;
+    uint16_t waitId;
+    uint16_t waitValue;
+    bool waiting;
+    bool done;
+};
+
+struct SerialState {
+    std::deque<uint8_t> wire;  // sent by the host, not yet received
+    uint64_t wireDueUs;
+    std::deque<uint8_t> rx;
+    int rxCapacity;
+    std::string tx;  // accepted but not yet on the wire
+    int txCapacity;
+    uint64_t txLastUs;
+    int baud;
+    std::string delimiters;
+    std::string output;  // on the wire, not yet taken by the host
+};
+
+struct StoredPair {
+    std::string key;
+    KeyValuePair pair;
+};
+
+static Fiber* s_current;
+static ucontext_t s_schedulerContext;
+static const void* s_schedulerStackBottom;
+static size_t s_schedulerStackSize;
+static uint64_t s_nowUs;
+static bool s_wallClock;
+static uint64_t s_wallBaseUs;
+static int (*s_firmwareMain)();
+static MicroBitIO* s_io;
+static MicroBitDisplay* s_display;
+static int s_accel[3] = {0, 0, -1024};
+static int s_accelPeriodMs = SIM_ACCEL_DEFAULT_PERIOD_MS;
+static uint64_t s_accelDueUs;
+static bool s_booted;
+static int s_heading;
+static bool s_compassCalibrated;
+static CompassCalibration s_compassCalibration;
+
+//----------------------------------------------------------------------------
+// Function statics, so components constructed during the firmware's static
+// initialization never see them unconstructed. They are never destroyed:
+// fibers and listeners outlive main(), as the device never shuts down, and
+// must stay reachable for the leak checker.
+static std::vector<Fiber*>& fibers() {
+    static std::vector<Fiber*>& list = *new std::vector<Fiber*>();
+    return list;
+}
+
+//----------------------------------------------------------------------------
+static std::vector<Listener*>& listeners() {
+    static std::vector<Listener*>& list = *new std::vector<Listener*>();
+    return list;
+}
+
+//----------------------------------------------------------------------------
+static std::vector<Ticker*>& tickers() {
+    static std::vector<Ticker*>& list = *new std::vector<Ticker*>();
+    return list;
+}
+
+//----------------------------------------------------------------------------
+static SerialState& serial() {
+    static SerialState& state = *new SerialState{std::deque<uint8_t>(), 0, std::deque<uint8_t>(),
+                                                  SIM_SERIAL_DEFAULT_BUFFER_SIZE, std::string(),
+                                                  SIM_SERIAL_DEFAULT_BUFFER_SIZE, 0, SIM_DEFAULT_BAUD, std::string(), std::string()};
+    return state;
+}
+
+//----------------------------------------------------------------------------
+static std::vector<StoredPair>& storage() {
+    static std::vector<StoredPair>& pairs = *new std::vector<StoredPair>();
+    return pairs;
+}
+
+//----------------------------------------------------------------------------
+// One character: start bit, 8 data bits and stop bit.
+static uint64_t serialByteUs() {
+    return 10 * 1000000ULL / serial().baud;
+}
+
+//----------------------------------------------------------------------------
+static uint64_t wallClockUs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+//============================================================================
+// Fibers
+
+//----------------------------------------------------------------------------
+static void startSwitch(void** fakeStack, const void* bottom, size_t size) {
+#if SIM_ASAN
+    __sanitizer_start_switch_fiber(fakeStack, bottom, size);
+#else
+    (void)fakeStack;
+    (void)bottom;
+    (void)size;
+#endif
+}
+
+//----------------------------------------------------------------------------
+static void finishSwitch(void* fakeStack, const void** bottom, size_t* size) {
+#if SIM_ASAN
+    __sanitizer_finish_switch_fiber(fakeStack, bottom, size);
+#else
+    (void)fakeStack;
+    (void)bottom;
+    (void)size;
+#endif
+}
+
+//----------------------------------------------------------------------------
+// Hands control back to the scheduler until the current fiber is resumed.
+static void yieldToScheduler() {
+    Fiber* fiber = s_current;
+    startSwitch(fiber->done ? NULL : &fiber->fakeStack, s_schedulerStackBottom, s_schedulerStackSize);
+    swapcontext(&fiber->context, &s_schedulerContext);
+    finishSwitch(fiber->fakeStack, &s_schedulerStackBottom, &s_schedulerStackSize);
+}
+
+//----------------------------------------------------------------------------
+// A listener's fiber handles the events queued while it was busy before it
+// ends, like the DAL's MESSAGE_BUS_LISTENER_QUEUE_IF_BUSY.
+static void runListener(Fiber* fiber) {
+    Listener* listener = fiber->listener;
+    listener->runs++;
+    listener->handler(fiber->event);
+    while (!listener->queued.empty()) {
+        MicroBitEvent e = listener->queued.front();
+        listener->queued.pop_front();
+        listener->runs++;
+        listener->handler(e);
+    }
+    listener->busy = false;
+}
+
+//----------------------------------------------------------------------------
+static void fiberMain() {
+    finishSwitch(NULL, &s_schedulerStackBottom, &s_schedulerStackSize);
+    Fiber* fiber = s_current;
+    if (fiber->listener) {
+        runListener(fiber);
+    } else {
+        fiber->entry();
+        if (fiber->completion) {
+            fiber->completion();
+        }
+    }
+    release_fiber();
+}
+
+//----------------------------------------------------------------------------
+static Fiber* newFiber() {
+    Fiber* fiber = new Fiber();
+    fiber->stack = malloc(SIM_FIBER_STACK_SIZE);
+    getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = fiber->stack;
+    fiber->context.uc_stack.ss_size = SIM_FIBER_STACK_SIZE;
+    fiber->context.uc_link = NULL;
+    makecontext(&fiber->context, fiberMain, 0);
+    fiber->wakeUs = s_nowUs;
+    fibers().push_back(fiber);
+    return fiber;
+}
+
+//----------------------------------------------------------------------------
+static void runFiber(Fiber* fiber) {
+    void* fakeStack = NULL;
+    s_current = fiber;
+    startSwitch(&fakeStack, fiber->stack, SIM_FIBER_STACK_SIZE);
+    swapcontext(&s_schedulerContext, &fiber->context);
+    finishSwitch(fakeStack, NULL, NULL);
+    s_current = NULL;
+}
+
+//----------------------------------------------------------------------------
+// Runs every fiber that is due now, and any they make due now, until all
+// are asleep or waiting. A fiber that never yields hangs this, as it would
+// hang the device.
+static void runReadyFibers() {
+    bool ran = true;
+    while (ran) {
+        ran = false;
+        for (size_t i = 0; i < fibers().size(); ++i) {
+            Fiber* fiber = fibers()[i];
+            if (fiber->done || fiber->waiting || fiber->wakeUs > s_nowUs) {
+                continue;
+            }
+            runFiber(fiber);
+            ran = true;
+        }
+        for (size_t i = 0; i < fibers().size();) {
+            if (fibers()[i]->done) {
+                free(fibers()[i]->stack);
+                delete fibers()[i];
+                fibers().erase(fibers().begin() + i);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+Fiber* create_fiber(void (*entry)(), void (*completion)()) {
+    Fiber* fiber = newFiber();
+    fiber->entry = entry;
+    fiber->completion = completion;
+    return fiber;
+}
+
+//----------------------------------------------------------------------------
+void release_fiber() {
+    if (!s_current) {
+        return;
+    }
+    s_current->done = true;
+    yieldToScheduler();
+    // A finished fiber is never resumed.
+    abort();
+}
+
+//----------------------------------------------------------------------------
+void fiber_sleep(unsigned long ms) {
+    if (!s_current) {
+        sim_run_for((uint64_t)ms * 1000);
+        return;
+    }
+    s_current->wakeUs = s_nowUs + (uint64_t)ms * 1000;
+    yieldToScheduler();
+}
+
+//----------------------------------------------------------------------------
+int fiber_wait_for_event(uint16_t id, uint16_t value) {
+    if (!s_current) {
+        fprintf(stderr, "fiber_wait_for_event outside a fiber\n");
+        abort();
+    }
+    s_current->waiting = true;
+    s_current->waitId = id;
+    s_current->waitValue = value;
+    yieldToScheduler();
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+static void sendEvent(const MicroBitEvent& e) {
+    // Handlers may add listeners, so index rather than iterate.
+    for (size_t i = 0; i < listeners().size(); ++i) {
+        Listener* listener = listeners()[i];
+        if ((listener->id != MICROBIT_ID_ANY && listener->id != e.source) ||
+            (listener->value != MICROBIT_EVT_ANY && listener->value != e.value)) {
+            continue;
+        }
+        if (listener->flags & MESSAGE_BUS_LISTENER_NONBLOCKING) {
+            listener->runs++;
+            listener->handler(e);
+        } else if (listener->busy) {
+            listener->queued.push_back(e);
+        } else {
+            listener->busy = true;
+            Fiber* fiber = newFiber();
+            fiber->listener = listener;
+            fiber->event = e;
+        }
+    }
+    for (size_t i = 0; i < fibers().size(); ++i) {
+        Fiber* fiber = fibers()[i];
+        if (fiber->waiting && (fiber->waitId == MICROBIT_ID_ANY || fiber->waitId == e.source) &&
+            (fiber->waitValue == MICROBIT_EVT_ANY || fiber->waitValue == e.value)) {
+            fiber->waiting = false;
+            fiber->wakeUs = s_nowUs;
+        }
+    }
+}
+
+//============================================================================
+// Time
+
+//----------------------------------------------------------------------------
+unsigned long system_timer_current_time() {
+    return (unsigned long)(system_timer_current_time_us() / 1000);
+}
+
+//----------------------------------------------------------------------------
+uint64_t system_timer_current_time_us() {
+    if (s_wallClock) {
+        return wallClockUs() - s_wallBaseUs;
+    }
+    return s_nowUs;
+}
+
+//----------------------------------------------------------------------------
+Ticker::Ticker() {
+    this->callback = NULL;
+    this->periodUs = 0;
+    this->dueUs = 0;
+}
+
+//----------------------------------------------------------------------------
+Ticker::~Ticker() {
+    this->detach();
+}
+
+//----------------------------------------------------------------------------
+void Ticker::attach_us(void (*callback)(), uint32_t us) {
+    this->detach();
+    this->callback = callback;
+    this->periodUs = us ? us : 1;
+    this->dueUs = s_nowUs + this->periodUs;
+    tickers().push_back(this);
+}
+
+//----------------------------------------------------------------------------
+void Ticker::detach() {
+    std::vector<Ticker*>& list = tickers();
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i] == this) {
+            list.erase(list.begin() + i);
+            return;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+static uint64_t nextDueUs() {
+    uint64_t next = UINT64_MAX;
+    for (size_t i = 0; i < fibers().size(); ++i) {
+        if (!fibers()[i]->waiting && fibers()[i]->wakeUs < next) {
+            next = fibers()[i]->wakeUs;
+        }
+    }
+    for (size_t i = 0; i < tickers().size(); ++i) {
+        if (tickers()[i]->dueUs < next) {
+            next = tickers()[i]->dueUs;
+        }
+    }
+    if (s_booted && s_accelDueUs < next) {
+        next = s_accelDueUs;
+    }
+    if (!serial().wire.empty() && serial().wireDueUs < next) {
+        next = serial().wireDueUs;
+    }
+    return next;
+}
+
+//----------------------------------------------------------------------------
+static bool attached(Ticker* ticker) {
+    for (size_t i = 0; i < tickers().size(); ++i) {
+        if (tickers()[i] == ticker) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------
+// The UART's RX interrupt, for one byte off the wire. The DAL's RX ring
+// holds one byte less than its size, and drops what doesn't fit.
+static void receiveSerialByte(uint8_t c) {
+    SerialState& state = serial();
+    if ((int)state.rx.size() >= state.rxCapacity - 1) {
+        return;
+    }
+    state.rx.push_back(c);
+    if (state.delimiters.find((char)c) != std::string::npos) {
+        MicroBitEvent(MICROBIT_ID_SERIAL, MICROBIT_SERIAL_EVT_DELIM_MATCH);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Interrupts due now. They run outside any fiber.
+static void fireDueInterrupts() {
+    // A callback may detach any ticker, itself included.
+    std::vector<Ticker*> due;
+    for (size_t i = 0; i < tickers().size(); ++i) {
+        if (tickers()[i]->dueUs <= s_nowUs) {
+            due.push_back(tickers()[i]);
+        }
+    }
+    for (size_t i = 0; i < due.size(); ++i) {
+        if (attached(due[i])) {
+            due[i]->dueUs += due[i]->periodUs;
+            due[i]->callback();
+        }
+    }
+    if (s_booted && s_accelDueUs <= s_nowUs) {
+        s_accelDueUs = s_nowUs + (uint64_t)s_accelPeriodMs * 1000;
+        MicroBitEvent(MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_EVT_DATA_UPDATE);
+    }
+    SerialState& state = serial();
+    if (!state.wire.empty() && state.wireDueUs <= s_nowUs) {
+        uint8_t c = state.wire.front();
+        state.wire.pop_front();
+        state.wireDueUs += serialByteUs();
+        receiveSerialByte(c);
+    }
+}
+
+//----------------------------------------------------------------------------
+void sim_run_for(uint64_t us) {
+    uint64_t end = s_nowUs + us;
+    while (1) {
+        runReadyFibers();
+        uint64_t next = nextDueUs();
+        if (next > end) {
+            s_nowUs = end;
+            return;
+        }
+        if (next > s_nowUs) {
+            s_nowUs = next;
+        }
+        fireDueInterrupts();
+    }
+}
+
+//----------------------------------------------------------------------------
+void sim_use_wall_clock(bool wall) {
+    s_wallClock = wall;
+    s_wallBaseUs = wallClockUs() - s_nowUs;
+}
+
+//----------------------------------------------------------------------------
+static void bootFiber() {
+    s_firmwareMain();
+}
+
+//----------------------------------------------------------------------------
+void sim_boot(int (*firmwareMain)()) {
+    s_firmwareMain = firmwareMain;
+    create_fiber(bootFiber);
+    sim_run_for(0);
+}
+
+//============================================================================
+// Values
+
+//----------------------------------------------------------------------------
+ManagedString::ManagedString() {
+}
+
+//----------------------------------------------------------------------------
+ManagedString::ManagedString(const char* str) : chars(str ? str : "") {
+}
+
+//----------------------------------------------------------------------------
+ManagedString::ManagedString(const char* str, const int16_t length) {
+    if (str && length > 0) {
+        this->chars.assign(str, length);
+    }
+}
+
+//----------------------------------------------------------------------------
+ManagedString::ManagedString(const char value) : chars(1, value) {
+}
+
+//----------------------------------------------------------------------------
+ManagedString::ManagedString(const int value) {
+    char digits[12];
+    snprintf(digits, sizeof(digits), "%d", value);
+    this->chars = digits;
+}
+
+//----------------------------------------------------------------------------
+ManagedString ManagedString::operator+(const ManagedString& rhs) const {
+    ManagedString sum;
+    sum.chars = this->chars + rhs.chars;
+    return sum;
+}
+
+//----------------------------------------------------------------------------
+bool ManagedString::operator==(const ManagedString& rhs) const {
+    return this->chars == rhs.chars;
+}
+
+//----------------------------------------------------------------------------
+const char* ManagedString::toCharArray() const {
+    return this->chars.c_str();
+}
+
+//----------------------------------------------------------------------------
+int16_t ManagedString::length() const {
+    return (int16_t)this->chars.size();
+}
+
+//----------------------------------------------------------------------------
+char ManagedString::charAt(int16_t index) const {
+    return index >= 0 && index < this->length() ? this->chars[index] : 0;
+}
+
+//----------------------------------------------------------------------------
+MicroBitImage::MicroBitImage() : width(5), height(5), pixels(25) {
+}
+
+//----------------------------------------------------------------------------
+MicroBitImage::MicroBitImage(const int16_t x, const int16_t y) : width(x), height(y), pixels(x * y) {
+}
+
+//----------------------------------------------------------------------------
+MicroBitImage::MicroBitImage(const int16_t x, const int16_t y, const uint8_t* bitmap)
+    : width(x), height(y), pixels(bitmap, bitmap + x * y) {
+}
+
+//----------------------------------------------------------------------------
+// Images here are copied by value, so a clone is just a copy.
+MicroBitImage MicroBitImage::clone() const {
+    return *this;
+}
+
+//----------------------------------------------------------------------------
+void MicroBitImage::clear() {
+    std::fill(this->pixels.begin(), this->pixels.end(), 0);
+}
+
+//----------------------------------------------------------------------------
+int MicroBitImage::setPixelValue(int16_t x, int16_t y, uint8_t value) {
+    if (x < 0 || y < 0 || x >= this->width || y >= this->height) {
+        return MICROBIT_INVALID_PARAMETER;
+    }
+    this->pixels[y * this->width + x] = value;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitImage::getPixelValue(int16_t x, int16_t y) const {
+    if (x < 0 || y < 0 || x >= this->width || y >= this->height) {
+        return MICROBIT_INVALID_PARAMETER;
+    }
+    return this->pixels[y * this->width + x];
+}
+
+//----------------------------------------------------------------------------
+int MicroBitImage::getWidth() const {
+    return this->width;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitImage::getHeight() const {
+    return this->height;
+}
+
+//----------------------------------------------------------------------------
+uint8_t* MicroBitImage::getBitmap() {
+    return this->pixels.data();
+}
+
+//----------------------------------------------------------------------------
+MicroBitEvent::MicroBitEvent() {
+    this->source = 0;
+    this->value = 0;
+    this->timestamp = 0;
+}
+
+//----------------------------------------------------------------------------
+MicroBitEvent::MicroBitEvent(uint16_t source, uint16_t value, MicroBitEventLaunchMode mode) {
+    this->source = source;
+    this->value = value;
+    this->timestamp = system_timer_current_time_us();
+    if (mode == CREATE_AND_FIRE) {
+        this->fire();
+    }
+}
+
+//----------------------------------------------------------------------------
+void MicroBitEvent::fire() {
+    sendEvent(*this);
+}
+
+//============================================================================
+// Components
+
+//----------------------------------------------------------------------------
+int MicroBitMessageBus::listen(uint16_t id, uint16_t value, void (*handler)(MicroBitEvent), uint16_t flags) {
+    Listener* listener = new Listener();
+    listener->id = id;
+    listener->value = value;
+    listener->handler = handler;
+    listener->flags = flags;
+    listener->busy = false;
+    listener->runs = 0;
+    listeners().push_back(listener);
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+// Moves whatever the UART has finished sending since last time to the
+// host's side.
+static void drainSerial() {
+    SerialState& state = serial();
+    uint64_t byteUs = serialByteUs();
+    if (state.tx.empty()) {
+        state.txLastUs = s_nowUs;
+        return;
+    }
+    size_t sent = (size_t)((s_nowUs - state.txLastUs) / byteUs);
+    if (sent > state.tx.size()) {
+        sent = state.tx.size();
+    }
+    state.output.append(state.tx, 0, sent);
+    state.tx.erase(0, sent);
+    state.txLastUs = state.tx.empty() ? s_nowUs : state.txLastUs + sent * byteUs;
+}
+
+//----------------------------------------------------------------------------
+MicroBitSerial::MicroBitSerial() {
+}
+
+//----------------------------------------------------------------------------
+void MicroBitSerial::baud(int baudrate) {
+    drainSerial();
+    serial().baud = baudrate > 0 ? baudrate : SIM_DEFAULT_BAUD;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitSerial::setRxBufferSize(uint8_t size) {
+    serial().rxCapacity = size;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitSerial::setTxBufferSize(uint8_t size) {
+    serial().txCapacity = size;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitSerial::getTxBufferSize() {
+    return serial().txCapacity;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitSerial::txBufferedSize() {
+    drainSerial();
+    return (int)serial().tx.size();
+}
+
+//----------------------------------------------------------------------------
+int MicroBitSerial::eventOn(ManagedString delimiters, MicroBitSerialMode) {
+    serial().delimiters = delimiters.toCharArray();
+    // A NUL delimiter doesn't survive toCharArray().
+    if (delimiters.length() == 1 && delimiters.charAt(0) == 0) {
+        serial().delimiters.assign(1, '\0');
+    }
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+// Lines arrive whole, so unlike the DAL this never waits for data: it
+// returns MICROBIT_NO_DATA instead.
+int MicroBitSerial::read(MicroBitSerialMode) {
+    SerialState& state = serial();
+    if (state.rx.empty()) {
+        return MICROBIT_NO_DATA;
+    }
+    uint8_t c = state.rx.front();
+    state.rx.pop_front();
+    return c;
+}
+
+//----------------------------------------------------------------------------
+// As in the DAL, ASYNC takes what fits in the TX buffer, which holds one
+// byte less than its size, and SYNC_SLEEP waits until all of it has fit.
+int MicroBitSerial::send(uint8_t* buffer, int length, MicroBitSerialMode mode) {
+    SerialState& state = serial();
+    drainSerial();
+    int room = state.txCapacity - 1 - (int)state.tx.size();
+    if (mode == ASYNC && length > room) {
+        length = room > 0 ? room : 0;
+    }
+    state.tx.append((const char*)buffer, length);
+    int excess = (int)state.tx.size() - (state.txCapacity - 1);
+    if (mode != ASYNC && excess > 0) {
+        fiber_sleep((unsigned long)((excess * serialByteUs() + 999) / 1000));
+    }
+    return length;
+}
+
+//----------------------------------------------------------------------------
+MicroBitDisplay::MicroBitDisplay() {
+    this->brightness = 255;
+    this->animation = 0;
+    s_display = this;
+}
+
+//----------------------------------------------------------------------------
+// Blocks for an animation of steps frames, unless stopAnimation() ends it.
+// Sleeps in slices, so it ends about as soon as on the device.
+void MicroBitDisplay::animate(int steps, int delay) {
+    uint32_t animation = this->animation;
+    for (int ms = 0; ms < steps * delay && animation == this->animation; ms += SIM_ANIMATION_SLICE_MS) {
+        fiber_sleep(std::min(SIM_ANIMATION_SLICE_MS, steps * delay - ms));
+    }
+}
+
+//----------------------------------------------------------------------------
+void MicroBitDisplay::enable() {
+}
+
+//----------------------------------------------------------------------------
+void MicroBitDisplay::setDisplayMode(DisplayMode) {
+}
+
+//----------------------------------------------------------------------------
+void MicroBitDisplay::setBrightness(int brightness) {
+    this->brightness = brightness;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitDisplay::getBrightness() const {
+    return this->brightness;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitDisplay::print(MicroBitImage i, int, int, int, int delay) {
+    this->image = i;
+    this->animate(1, delay);
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitDisplay::print(ManagedString s, int delay) {
+    this->animate(s.length(), delay);
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitDisplay::scroll(MicroBitImage image, int delay, int) {
+    this->animate(image.getWidth() + 5, delay);
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitDisplay::scroll(ManagedString s, int delay) {
+    this->animate(6 * s.length() + 5, delay);
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitDisplay::scrollAsync(ManagedString, int) {
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+// As in the DAL, this also clears the display.
+void MicroBitDisplay::stopAnimation() {
+    this->animation++;
+    this->image.clear();
+}
+
+//----------------------------------------------------------------------------
+MicroBitPin::MicroBitPin() {
+    this->id = 0;
+    this->status = 0;
+    this->pullMode = PullDown;
+    this->level = 0;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::setDigitalValue(int value) {
+    this->status = IO_STATUS_DIGITAL_OUT;
+    this->level = value ? MICROBIT_PIN_MAX_OUTPUT : 0;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::getDigitalValue() {
+    if (!(this->status & (IO_STATUS_DIGITAL_IN | IO_STATUS_EVENT_ON_EDGE))) {
+        this->status = IO_STATUS_DIGITAL_IN;
+    }
+    return this->level >= 512 ? 1 : 0;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::getDigitalValue(PinMode pull) {
+    this->setPull(pull);
+    return this->getDigitalValue();
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::setAnalogValue(int value) {
+    if (value < 0 || value > MICROBIT_PIN_MAX_OUTPUT) {
+        return MICROBIT_INVALID_PARAMETER;
+    }
+    this->status = IO_STATUS_ANALOG_OUT;
+    this->level = value;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::getAnalogValue() {
+    this->status = IO_STATUS_ANALOG_IN;
+    return this->level;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::setAnalogPeriodUs(int) {
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::setServoValue(int value) {
+    this->status = IO_STATUS_ANALOG_OUT;
+    this->level = value;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::setPull(PinMode pull) {
+    this->pullMode = pull;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::eventOn(int eventType) {
+    if (eventType == MICROBIT_PIN_EVENT_ON_EDGE) {
+        this->status = IO_STATUS_EVENT_ON_EDGE;
+    } else if (this->status & IO_STATUS_EVENT_ON_EDGE) {
+        this->status = 0;
+    }
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::isInput() {
+    return (this->status & (IO_STATUS_DIGITAL_IN | IO_STATUS_ANALOG_IN)) ? 1 : 0;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitPin::isAnalog() {
+    return (this->status & (IO_STATUS_ANALOG_IN | IO_STATUS_ANALOG_OUT)) ? 1 : 0;
+}
+
+//----------------------------------------------------------------------------
+MicroBitIO::MicroBitIO() {
+    for (int i = 0; i < MICROBIT_IO_PINS; ++i) {
+        this->pin[i].id = MICROBIT_ID_IO_P0 + i;
+    }
+    s_io = this;
+}
+
+//----------------------------------------------------------------------------
+void MicroBitButton::setEventConfiguration(int) {
+}
+
+//----------------------------------------------------------------------------
+int MicroBitAccelerometer::setRange(int) {
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitAccelerometer::setPeriod(int period) {
+    s_accelPeriodMs = period > 0 ? period : 1;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitAccelerometer::getPeriod() {
+    return s_accelPeriodMs;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitAccelerometer::configure() {
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitAccelerometer::getX() {
+    return s_accel[0];
+}
+
+//----------------------------------------------------------------------------
+int MicroBitAccelerometer::getY() {
+    return s_accel[1];
+}
+
+//----------------------------------------------------------------------------
+int MicroBitAccelerometer::getZ() {
+    return s_accel[2];
+}
+
+//----------------------------------------------------------------------------
+int MicroBitCompass::heading() {
+    return s_heading;
+}
+
+//----------------------------------------------------------------------------
+// Stands in for the user tilting the device until the screen fills. Like
+// the DAL's, it draws on the display and leaves its drawing there.
+int MicroBitCompass::calibrate() {
+    if (s_display) {
+        for (int i = 0; i < 25; ++i) {
+            s_display->image.setPixelValue(i % 5, i / 5, 255);
+        }
+    }
+    fiber_sleep(SIM_CALIBRATION_MS);
+    s_compassCalibrated = true;
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitCompass::isCalibrated() {
+    return s_compassCalibrated;
+}
+
+//----------------------------------------------------------------------------
+void MicroBitCompass::setCalibration(CompassCalibration calibration) {
+    s_compassCalibration = calibration;
+    s_compassCalibrated = true;
+}
+
+//----------------------------------------------------------------------------
+CompassCalibration MicroBitCompass::getCalibration() {
+    return s_compassCalibration;
+}
+
+//----------------------------------------------------------------------------
+void MicroBitCompass::clearCalibration() {
+    s_compassCalibrated = false;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitStorage::put(const char* key, uint8_t* data, int dataSize) {
+    if (!key || strlen(key) >= MICROBIT_STORAGE_KEY_SIZE || dataSize < 0 || dataSize > MICROBIT_STORAGE_VALUE_SIZE) {
+        return MICROBIT_INVALID_PARAMETER;
+    }
+    this->remove(key);
+    if (storage().size() >= MICROBIT_STORAGE_ENTRIES) {
+        return MICROBIT_NO_DATA;
+    }
+    StoredPair stored;
+    stored.key = key;
+    memset(&stored.pair, 0, sizeof(stored.pair));
+    memcpy(stored.pair.key, key, strlen(key));
+    memcpy(stored.pair.value, data, dataSize);
+    storage().push_back(stored);
+    return MICROBIT_OK;
+}
+
+//----------------------------------------------------------------------------
+// As in the DAL, the caller deletes the pair.
+KeyValuePair* MicroBitStorage::get(const char* key) {
+    for (size_t i = 0; i < storage().size(); ++i) {
+        if (storage()[i].key == key) {
+            return new KeyValuePair(storage()[i].pair);
+        }
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+int MicroBitStorage::remove(const char* key) {
+    for (size_t i = 0; i < storage().size(); ++i) {
+        if (storage()[i].key == key) {
+            storage().erase(storage().begin() + i);
+            return MICROBIT_OK;
+        }
+    }
+    return MICROBIT_NO_DATA;
+}
+
+//----------------------------------------------------------------------------
+void MicroBit::init() {
+    s_booted = true;
+    s_accelDueUs = s_nowUs + (uint64_t)s_accelPeriodMs * 1000;
+}
+
+//============================================================================
+// Host side
+
+//----------------------------------------------------------------------------
+void sim_serial_receive(const uint8_t* bytes, int length) {
+    SerialState& state = serial();
+    if (state.wire.empty()) {
+        state.wireDueUs = s_nowUs + serialByteUs();
+    }
+    state.wire.insert(state.wire.end(), bytes, bytes + length);
+}
+
+//----------------------------------------------------------------------------
+std::string sim_serial_take_output() {
+    drainSerial();
+    std::string output;
+    output.swap(serial().output);
+    return output;
+}
+
+//----------------------------------------------------------------------------
+uint32_t sim_handler_runs(uint16_t source) {
+    uint32_t runs = 0;
+    for (size_t i = 0; i < listeners().size(); ++i) {
+        if (listeners()[i]->id == source) {
+            runs += listeners()[i]->runs;
+        }
+    }
+    return runs;
+}
+
+//----------------------------------------------------------------------------
+int sim_display_pixel(int x, int y) {
+    return s_display ? s_display->image.getPixelValue(x, y) : 0;
+}
+
+//----------------------------------------------------------------------------
+int sim_display_brightness() {
+    return s_display ? s_display->getBrightness() : 0;
+}
+
+//----------------------------------------------------------------------------
+void sim_set_button(int button, bool down) {
+    uint16_t id = button ? MICROBIT_ID_BUTTON_B : MICROBIT_ID_BUTTON_A;
+    MicroBitEvent(id, down ? MICROBIT_BUTTON_EVT_DOWN : MICROBIT_BUTTON_EVT_UP);
+    if (!down) {
+        MicroBitEvent(id, MICROBIT_BUTTON_EVT_CLICK);
+    }
+}
+
+//----------------------------------------------------------------------------
+void sim_gesture(int gesture) {
+    MicroBitEvent(MICROBIT_ID_GESTURE, gesture);
+}
+
+//----------------------------------------------------------------------------
+void sim_set_accel(int x, int y, int z) {
+    s_accel[0] = x;
+    s_accel[1] = y;
+    s_accel[2] = z;
+}
+
+//----------------------------------------------------------------------------
+void sim_set_heading(int degrees) {
+    s_heading = degrees;
+}
+
+//----------------------------------------------------------------------------
+void sim_set_pin(int pin, int level) {
+    if (!s_io || pin < 0 || pin >= MICROBIT_IO_PINS) {
+        return;
+    }
+    MicroBitPin& target = s_io->pin[pin];
+    bool was = target.level >= 512;
+    target.level = level;
+    bool is = target.level >= 512;
+    if ((target.status & IO_STATUS_EVENT_ON_EDGE) && was != is) {
+        MicroBitEvent(target.id, is ? MICROBIT_PIN_EVT_RISE : MICROBIT_PIN_EVT_FALL);
+    }
+}
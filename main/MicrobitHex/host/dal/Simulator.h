@@ -0,0 +1,47 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+
+#include <string>
+
+// Host side of the simulated DAL in MicroBit.h. There is one device. Time
+// is simulated and only moves in sim_run_for(), so runs are repeatable and
+// as fast as the host allows. Fibers are real coroutines on their own
+// stacks, scheduled cooperatively as on the device.
+
+// Runs firmwareMain in the first fiber, as the DAL runs main(), up to the
+// point where it first waits.
+void sim_boot(int (*firmwareMain)());
+
+// Runs fibers, timer interrupts and the UART for us of simulated time.
+// Outside a fiber, fiber_sleep() does the same.
+void sim_run_for(uint64_t us);
+
+// Benchmarks need real time: the clock then follows the host's monotonic
+// clock instead of the simulated one. Fiber scheduling is unaffected.
+void sim_use_wall_clock(bool wall);
+
+// Serial, at the configured baud rate in both directions. Bytes the host
+// sends are received one character time apart, firing the delimiter event
+// for each delimiter that fits the RX buffer.
+void sim_serial_receive(const uint8_t* bytes, int length);
+std::string sim_serial_take_output();
+
+// How many times message bus handlers listening to source have been
+// called, each a wakeup of the firmware.
+uint32_t sim_handler_runs(uint16_t source);
+
+// What the display shows.
+int sim_display_pixel(int x, int y);
+int sim_display_brightness();
+
+// Inputs. Pin levels are 0-1023; digital reads see 512 and up as 1, and a
+// pin with edge events on fires them as its digital value changes.
+void sim_set_button(int button, bool down);
+void sim_gesture(int gesture);
+void sim_set_accel(int x, int y, int z);
+void sim_set_heading(int degrees);
+void sim_set_pin(int pin, int level);
+
+#endif  // SIMULATOR_H
@@ -0,0 +1,155 @@
+#include "AccelFilter.h"
+
+#include <string.h>
+
+//============================================================================
+
+//----------------------------------------------------------------------------
+static uint32_t isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value) bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+//----------------------------------------------------------------------------
+// atan(num / den) in whole degrees, for den >= 0. Within a degree, using
+// atan(q) ~= 45q + 15.64q(1 - q) on the octant where q <= 1.
+static int16_t atanDegrees(int32_t num, int32_t den) {
+    int32_t a = num < 0 ? -num : num;
+    if (!a && !den)
+        return 0;
+    bool swapped = a > den;
+    int32_t q = swapped ? (den << 15) / a : (a << 15) / den;  // Q15
+    int32_t centi = (4500 * q + 1564 * ((q * (32768 - q)) >> 15)) >> 15;
+    if (swapped)
+        centi = 9000 - centi;
+    int16_t degrees = (centi + 50) / 100;
+    return num < 0 ? -degrees : degrees;
+}
+
+//----------------------------------------------------------------------------
+static int16_t median(const int16_t* values, int count) {
+    int16_t sorted[ACCEL_FILTER_MAX_WINDOW];
+    memcpy(sorted, values, count * sizeof(int16_t));
+    for (int i = 1; i < count; ++i) {
+        int16_t v = sorted[i];
+        int j = i;
+        for (; j > 0 && sorted[j - 1] > v; --j) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = v;
+    }
+    return sorted[count / 2];
+}
+
+//----------------------------------------------------------------------------
+AccelFilter::AccelFilter() {
+    this->type = ACCEL_FILTER_NONE;
+    this->strength = 0;
+    this->reset();
+}
+
+//----------------------------------------------------------------------------
+bool AccelFilter::configure(EAccelFilter filter, uint8_t strength) {
+    switch (filter) {
+        case ACCEL_FILTER_NONE:
+            break;
+        case ACCEL_FILTER_EMA:
+            if (strength < 1 || strength > ACCEL_FILTER_MAX_SHIFT)
+                return false;
+            break;
+        case ACCEL_FILTER_MEDIAN:
+            if (strength != 3 && strength != ACCEL_FILTER_MAX_WINDOW)
+                return false;
+            break;
+        default:
+            return false;
+    }
+    this->type = filter;
+    this->strength = strength;
+    this->reset();
+    return true;
+}
+
+//----------------------------------------------------------------------------
+EAccelFilter AccelFilter::filter() const {
+    return this->type;
+}
+
+//----------------------------------------------------------------------------
+void AccelFilter::reset() {
+    this->count = 0;
+    this->next = 0;
+    memset(this->ema, 0, sizeof(this->ema));
+    memset(this->window, 0, sizeof(this->window));
+}
+
+//----------------------------------------------------------------------------
+void AccelFilter::add(int16_t x, int16_t y, int16_t z) {
+    int16_t sample[3] = {x, y, z};
+    for (int i = 0; i < 3; ++i) {
+        if (this->type == ACCEL_FILTER_EMA) {
+            int32_t target = (int32_t)sample[i] * 256;
+            if (!this->count) {
+                // Start from the first sample rather than climbing from 0.
+                this->ema[i] = target;
+            } else {
+                this->ema[i] += (target - this->ema[i]) >> this->strength;
+            }
+        }
+        // The latest sample is kept in every mode, for ACCEL_FILTER_NONE.
+        this->window[i][this->next] = sample[i];
+    }
+    if (this->type == ACCEL_FILTER_MEDIAN) {
+        this->next = (this->next + 1) % this->strength;
+        if (this->count < this->strength)
+            ++this->count;
+    } else {
+        this->count = 1;
+    }
+}
+
+//----------------------------------------------------------------------------
+bool AccelFilter::get(int16_t* acc) const {
+    if (!this->count)
+        return false;
+    for (int i = 0; i < 3; ++i) {
+        switch (this->type) {
+            case ACCEL_FILTER_EMA:
+                acc[i] = (int16_t)((this->ema[i] + 128) >> 8);
+                break;
+            case ACCEL_FILTER_MEDIAN:
+                // Until the window fills, the median of what there is.
+                acc[i] = median(this->window[i], this->count);
+                break;
+            default:
+                acc[i] = this->window[i][0];
+                break;
+        }
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+int16_t AccelFilter::pitch(const int16_t* acc) {
+    int32_t x = acc[0];
+    int32_t z = acc[2];
+    return atanDegrees(acc[1], isqrt(x * x + z * z));
+}
+
+//----------------------------------------------------------------------------
+int16_t AccelFilter::roll(const int16_t* acc) {
+    int32_t y = acc[1];
+    int32_t z = acc[2];
+    return atanDegrees(acc[0], isqrt(y * y + z * z));
+}
@@ -0,0 +1,52 @@
+#ifndef ACCEL_FILTER_H
+#define ACCEL_FILTER_H
+
+#include <stdint.h>
+
+// Largest median window.
+#define ACCEL_FILTER_MAX_WINDOW 5
+// Largest EMA shift.
+#define ACCEL_FILTER_MAX_SHIFT 6
+
+enum EAccelFilter {
+    // The latest sample, as read at send time before filtering existed.
+    ACCEL_FILTER_NONE = 0,
+    // Exponential moving average, each sample weighted 1 / 2^strength.
+    ACCEL_FILTER_EMA = 1,
+    // Median of the last strength samples, 3 or 5.
+    ACCEL_FILTER_MEDIAN = 2,
+};
+
+// Smooths accelerometer samples as they arrive, so the value sent at each
+// sampled state tick reflects every sample since the last one rather than a
+// single noisy read. All integer math.
+class AccelFilter {
+   public:
+    AccelFilter();
+
+    // Returns false, leaving the filter as it was, if strength is out of
+    // range for the filter type. Restarts from the next sample.
+    bool configure(EAccelFilter filter, uint8_t strength);
+    EAccelFilter filter() const;
+    void reset();
+
+    // Adds a sample, in mg.
+    void add(int16_t x, int16_t y, int16_t z);
+    // Returns false if no sample has been added since the last reset.
+    bool get(int16_t* acc) const;
+
+    // Tilt in whole degrees from gravity along acc: pitch about the X axis,
+    // roll about the Y axis, each -90 to 90.
+    static int16_t pitch(const int16_t* acc);
+    static int16_t roll(const int16_t* acc);
+
+   private:
+    EAccelFilter type;
+    uint8_t strength;
+    uint8_t count;  // samples held, up to the median window
+    uint8_t next;   // median slot the next sample goes in
+    int32_t ema[3];  // Q8
+    int16_t window[3][ACCEL_FILTER_MAX_WINDOW];
+};
+
+#endif  // ACCEL_FILTER_H
@@ -0,0 +1,144 @@
+#include "AnalogCapture.h"
+
+//============================================================================
+
+enum ECaptureState {
+    CAPTURE_IDLE = 0,
+    CAPTURE_ARMED = 1,
+    CAPTURE_TRIGGERED = 2,
+    CAPTURE_DONE = 3,
+};
+
+//----------------------------------------------------------------------------
+AnalogCapture::AnalogCapture() {
+    this->state = CAPTURE_IDLE;
+    this->trigger = CAPTURE_TRIGGER_NONE;
+    this->decimation = 1;
+    this->level = 0;
+    this->preTrigger = 0;
+    this->capacity = 0;
+    this->last = 0;
+    this->stop();
+}
+
+//----------------------------------------------------------------------------
+bool AnalogCapture::configure(uint8_t decimation, ECaptureTrigger trigger, uint16_t level, uint16_t preTrigger,
+                              uint16_t count) {
+    if (decimation < 1 || decimation > CAPTURE_MAX_DECIMATION)
+        return false;
+    if (trigger != CAPTURE_TRIGGER_NONE && trigger != CAPTURE_TRIGGER_RISING && trigger != CAPTURE_TRIGGER_FALLING)
+        return false;
+    if (count < 1 || count > CAPTURE_MAX_SAMPLES)
+        return false;
+    if (trigger == CAPTURE_TRIGGER_NONE)
+        preTrigger = 0;
+    if (preTrigger >= count)
+        return false;
+    this->stop();
+    this->decimation = decimation;
+    this->trigger = trigger;
+    this->level = level;
+    this->preTrigger = preTrigger;
+    this->capacity = count;
+    if (trigger == CAPTURE_TRIGGER_NONE) {
+        this->remaining = count;
+        this->state = CAPTURE_TRIGGERED;
+    } else {
+        this->state = CAPTURE_ARMED;
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+void AnalogCapture::stop() {
+    this->state = CAPTURE_IDLE;
+    this->phase = 0;
+    this->sum = 0;
+    this->filled = 0;
+    this->next = 0;
+    this->remaining = 0;
+    this->previous = 0;
+}
+
+//----------------------------------------------------------------------------
+bool AnalogCapture::add(uint16_t raw) {
+    this->last = raw;
+    if (this->state != CAPTURE_ARMED && this->state != CAPTURE_TRIGGERED)
+        return false;
+    this->sum += raw;
+    if (++this->phase < this->decimation)
+        return false;
+    uint16_t sample = this->sum / this->decimation;
+    this->phase = 0;
+    this->sum = 0;
+
+    // The trigger only counts once the samples before it are all there.
+    if (this->state == CAPTURE_ARMED && this->filled && this->filled >= this->preTrigger) {
+        bool crossed = this->trigger == CAPTURE_TRIGGER_RISING
+                           ? this->previous < this->level && sample >= this->level
+                           : this->previous > this->level && sample <= this->level;
+        if (crossed) {
+            this->remaining = this->capacity - this->preTrigger;
+            this->state = CAPTURE_TRIGGERED;
+        }
+    }
+    this->previous = sample;
+    this->samples[this->next] = sample;
+    this->next = (this->next + 1) % this->capacity;
+    if (this->filled < this->capacity)
+        ++this->filled;
+    if (this->state == CAPTURE_TRIGGERED && !--this->remaining) {
+        this->state = CAPTURE_DONE;
+        return true;
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------
+bool AnalogCapture::running() const {
+    return this->state == CAPTURE_ARMED || this->state == CAPTURE_TRIGGERED;
+}
+
+//----------------------------------------------------------------------------
+bool AnalogCapture::done() const {
+    return this->state == CAPTURE_DONE;
+}
+
+//----------------------------------------------------------------------------
+uint16_t AnalogCapture::latest() const {
+    return this->last;
+}
+
+//----------------------------------------------------------------------------
+uint16_t AnalogCapture::count() const {
+    return this->capacity;
+}
+
+//----------------------------------------------------------------------------
+uint16_t AnalogCapture::triggerIndex() const {
+    return this->preTrigger;
+}
+
+//----------------------------------------------------------------------------
+int AnalogCapture::pack(uint16_t first, uint16_t n, uint8_t* dst) const {
+    if (this->state != CAPTURE_DONE || first >= this->capacity)
+        return 0;
+    if (n > this->capacity - first)
+        n = this->capacity - first;
+    // Once done, the ring is full and next is the oldest sample.
+    uint32_t bits = 0;
+    int pending = 0;
+    int length = 0;
+    for (uint16_t i = 0; i < n; ++i) {
+        bits = (bits << 10) | (this->samples[(this->next + first + i) % this->capacity] & 0x3FF);
+        pending += 10;
+        while (pending >= 8) {
+            pending -= 8;
+            dst[length++] = (uint8_t)(bits >> pending);
+        }
+    }
+    if (pending) {
+        dst[length++] = (uint8_t)(bits << (8 - pending));
+    }
+    return length;
+}
@@ -0,0 +1,65 @@
+#ifndef ANALOG_CAPTURE_H
+#define ANALOG_CAPTURE_H
+
+#include <stdint.h>
+
+// Samples one capture can hold.
+#define CAPTURE_MAX_SAMPLES 512
+// Most raw samples averaged into each stored one.
+#define CAPTURE_MAX_DECIMATION 64
+
+enum ECaptureTrigger {
+    // Captures from the first sample.
+    CAPTURE_TRIGGER_NONE = 0,
+    // Waits for a sample at or above level after one below it.
+    CAPTURE_TRIGGER_RISING = 1,
+    // Waits for a sample at or below level after one above it.
+    CAPTURE_TRIGGER_FALLING = 2,
+};
+
+// One-shot capture of 10-bit analog samples into a ring buffer, fed from a
+// timer interrupt. Until the trigger, the ring keeps the latest preTrigger
+// samples; after it, capture runs until the ring holds count samples and
+// then stops taking more. All integer math.
+class AnalogCapture {
+   public:
+    AnalogCapture();
+
+    // Returns false, leaving the capture as it was, if an argument is out of
+    // range. Otherwise starts over, waiting for the trigger.
+    bool configure(uint8_t decimation, ECaptureTrigger trigger, uint16_t level, uint16_t preTrigger, uint16_t count);
+    void stop();
+
+    // Adds a raw sample. Returns true when it completes the capture. Only
+    // call while running(); never reenters, so it can run in an interrupt.
+    bool add(uint16_t raw);
+    bool running() const;
+    bool done() const;
+    // The last raw sample added.
+    uint16_t latest() const;
+
+    // Once done(), the samples in time order, the trigger being triggerIndex().
+    uint16_t count() const;
+    uint16_t triggerIndex() const;
+    // Packs n samples from first on as a stream of 10-bit values, most
+    // significant bit first, into dst. Returns the bytes written.
+    int pack(uint16_t first, uint16_t n, uint8_t* dst) const;
+
+   private:
+    volatile uint8_t state;
+    ECaptureTrigger trigger;
+    uint8_t decimation;
+    uint8_t phase;  // raw samples in sum
+    uint32_t sum;
+    uint16_t level;
+    uint16_t preTrigger;
+    uint16_t capacity;
+    uint16_t filled;
+    uint16_t next;
+    uint16_t remaining;  // samples still to take once triggered
+    uint16_t previous;
+    volatile uint16_t last;
+    uint16_t samples[CAPTURE_MAX_SAMPLES];
+};
+
+#endif  // ANALOG_CAPTURE_H
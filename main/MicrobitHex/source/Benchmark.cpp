@@ -0,0 +1,309 @@
+#include "MicroBit.h"
+
+#include "Benchmark.h"
+
+#if KODU_BENCHMARKS
+
+#include "Message.h"
+#include "CommandParser.h"
+#include "Commands.h"
+
+//============================================================================
+
+#define BENCH_ITERATIONS 500
+#define BENCH_MSG_SIZE 120
+
+// Each benchmark runs its op the given number of times and returns the wire
+// bytes moved by one op.
+typedef int (*BenchFn)(int iterations);
+
+struct BenchCase {
+    const char* name;
+    BenchFn fn;
+};
+
+static volatile uint32_t s_sink;
+
+//----------------------------------------------------------------------------
+static int benchWriteU8Hex(int iterations) {
+    Message msg(BENCH_MSG_SIZE);
+    msg.writeU8Hex(0xA5);
+    int bytes = msg.length();
+    while (iterations--) {
+        if (!msg.writeU8Hex(0xA5)) {
+            msg.clear();
+            msg.writeU8Hex(0xA5);
+        }
+    }
+    return bytes;
+}
+
+//----------------------------------------------------------------------------
+static int benchWriteU16Hex(int iterations) {
+    Message msg(BENCH_MSG_SIZE);
+    msg.writeU16Hex(0xA55A);
+    int bytes = msg.length();
+    while (iterations--) {
+        if (!msg.writeU16Hex(0xA55A)) {
+            msg.clear();
+            msg.writeU16Hex(0xA55A);
+        }
+    }
+    return bytes;
+}
+
+//----------------------------------------------------------------------------
+static int benchWriteU32Hex(int iterations) {
+    Message msg(BENCH_MSG_SIZE);
+    msg.writeU32Hex(0xA55A5AA5);
+    int bytes = msg.length();
+    while (iterations--) {
+        if (!msg.writeU32Hex(0xA55A5AA5)) {
+            msg.clear();
+            msg.writeU32Hex(0xA55A5AA5);
+        }
+    }
+    return bytes;
+}
+
+//----------------------------------------------------------------------------
+static int benchWriteString(int iterations) {
+    Message msg(BENCH_MSG_SIZE);
+    msg.writeString("hello");
+    int bytes = msg.length();
+    while (iterations--) {
+        if (!msg.writeString("hello")) {
+            msg.clear();
+            msg.writeString("hello");
+        }
+    }
+    return bytes;
+}
+
+//----------------------------------------------------------------------------
+static int benchReadU16Hex(int iterations) {
+    Message src(BENCH_MSG_SIZE);
+    int count = 0;
+    while (src.writeU16Hex(0xA55A)) ++count;
+    Message msg(src.charBuffer(), src.length());
+    uint16_t value = 0;
+    while (iterations--) {
+        if (!msg.readU16Hex(value)) {
+            msg.rewind();
+            msg.readU16Hex(value);
+        }
+        s_sink += value;
+    }
+    return src.length() / count;
+}
+
+//----------------------------------------------------------------------------
+static int benchReadU32Hex(int iterations) {
+    Message src(BENCH_MSG_SIZE);
+    int count = 0;
+    while (src.writeU32Hex(0xA55A5AA5)) ++count;
+    Message msg(src.charBuffer(), src.length());
+    uint32_t value = 0;
+    while (iterations--) {
+        if (!msg.readU32Hex(value)) {
+            msg.rewind();
+            msg.readU32Hex(value);
+        }
+        s_sink += value;
+    }
+    return src.length() / count;
+}
+
+//----------------------------------------------------------------------------
+static int benchReadImage(int iterations) {
+    Message src(BENCH_MSG_SIZE);
+    int count = 0;
+    while (src.writeChars("VGGGG", 5)) ++count;
+    Message msg(src.charBuffer(), src.length());
+    MicroBitImage image;
+    while (iterations--) {
+        if (!msg.readImage(image)) {
+            msg.rewind();
+            msg.readImage(image);
+        }
+    }
+    s_sink += image.getPixelValue(0, 0);
+    return src.length() / count;
+}
+
+//----------------------------------------------------------------------------
+static int benchConsume(int iterations) {
+    Message src(BENCH_MSG_SIZE);
+    int count = 0;
+    while (src.writeChar('P')) ++count;
+    Message msg(src.charBuffer(), src.length());
+    while (iterations--) {
+        if (!msg.consume("P")) {
+            msg.rewind();
+            msg.consume("P");
+        }
+    }
+    return src.length() / count;
+}
+
+//----------------------------------------------------------------------------
+// Same shape as sendSampledState with one analog input pin.
+static int benchEncodeSampledState(int iterations) {
+    int bytes = 0;
+    while (iterations--) {
+        Message msg(50);
+        msg.writeChar('c');
+        if (msg.format() == WIRE_FORMAT_BINARY) {
+            msg.writeU8Hex(0x0B);
+        } else {
+            msg.writeChar('b');
+        }
+        msg.writeU8Hex(2);
+        msg.writeU8Hex(2);
+        if (msg.format() == WIRE_FORMAT_ASCII) {
+            msg.writeChar('a');
+        }
+        msg.writeU16Hex(-120);
+        msg.writeU16Hex(48);
+        msg.writeU16Hex(-1012);
+        if (msg.format() == WIRE_FORMAT_ASCII) {
+            msg.writeChar('p');
+        }
+        msg.writeU8Hex(1);
+        msg.writeU8Hex(0);
+        msg.writeChar('a');
+        msg.writeU16Hex(512);
+        bytes = msg.finalize();
+    }
+    return bytes;
+}
+
+//----------------------------------------------------------------------------
+// Same parse as printDisplayFramesFiber, without touching the display.
+static int benchDecodePrintDisplayFrames(int iterations) {
+    Message src(BENCH_MSG_SIZE);
+    src.writeChar('J');
+    src.writeU8Hex(4);
+    const char* frames[] = {"VGGGG", "1111V", "44V44", "HA4AH"};
+    for (int i = 0; i < 4; ++i) {
+        src.writeU16Hex(1000);
+        src.writeU8Hex(255);
+        src.writeChars(frames[i], 5);
+    }
+    Message msg(src.charBuffer(), src.length());
+    MicroBitImage image;
+    while (iterations--) {
+        uint8_t count = 0;
+        msg.rewind();
+        msg.consume('J');
+        msg.readU8Hex(count);
+        while (count--) {
+            uint16_t durationMs;
+            uint8_t brightness;
+            if (!msg.readU16Hex(durationMs) || !msg.readU8Hex(brightness) || !msg.readImage(image))
+                break;
+            s_sink += durationMs + brightness;
+        }
+    }
+    return src.length();
+}
+
+//----------------------------------------------------------------------------
+// A CMD_SET_PIN_PWM_OUT to parse: one field at a time, as the handlers
+// used to, then with parseCommand and with decodeCommand, to show what the
+// template parser and the Commands.h schema cost.
+static void writeSetPinPwmOut(Message& src) {
+    CmdSetPinPwmOut cmd = {0, 500, 1, 512};
+    encodeCommand(src, cmd);
+}
+
+//----------------------------------------------------------------------------
+static int benchParseFieldByField(int iterations) {
+    Message src(BENCH_MSG_SIZE);
+    writeSetPinPwmOut(src);
+    Message msg(src.charBuffer(), src.length());
+    while (iterations--) {
+        uint8_t pin;
+        uint16_t frequencyHz, frequencyMultiplier, dutyCycle;
+        msg.rewind();
+        if (msg.consume('K') && msg.readU8Hex(pin) && msg.readU16Hex(frequencyHz) &&
+            msg.readU16Hex(frequencyMultiplier) && msg.readU16Hex(dutyCycle)) {
+            s_sink += pin + frequencyHz + frequencyMultiplier + dutyCycle;
+        }
+    }
+    return src.length();
+}
+
+//----------------------------------------------------------------------------
+static int benchParseCommand(int iterations) {
+    Message src(BENCH_MSG_SIZE);
+    writeSetPinPwmOut(src);
+    Message msg(src.charBuffer(), src.length());
+    while (iterations--) {
+        uint8_t pin;
+        uint16_t frequencyHz, frequencyMultiplier, dutyCycle;
+        msg.rewind();
+        if (parseCommand(msg, 'K', pin, frequencyHz, frequencyMultiplier, dutyCycle)) {
+            s_sink += pin + frequencyHz + frequencyMultiplier + dutyCycle;
+        }
+    }
+    return src.length();
+}
+
+//----------------------------------------------------------------------------
+static int benchDecodeCommand(int iterations) {
+    Message src(BENCH_MSG_SIZE);
+    writeSetPinPwmOut(src);
+    Message msg(src.charBuffer(), src.length());
+    while (iterations--) {
+        CmdSetPinPwmOut cmd;
+        msg.rewind();
+        if (decodeCommand(msg, cmd)) {
+            s_sink += cmd.pin + cmd.frequencyHz + cmd.frequencyMultiplier + cmd.dutyCycle;
+        }
+    }
+    return src.length();
+}
+
+//----------------------------------------------------------------------------
+static const BenchCase s_benchCases[] = {
+    {"writeU8Hex", benchWriteU8Hex},
+    {"writeU16Hex", benchWriteU16Hex},
+    {"writeU32Hex", benchWriteU32Hex},
+    {"writeString", benchWriteString},
+    {"readU16Hex", benchReadU16Hex},
+    {"readU32Hex", benchReadU32Hex},
+    {"readImage", benchReadImage},
+    {"consume", benchConsume},
+    {"encodeSampledState", benchEncodeSampledState},
+    {"decodePrintDisplayFrames", benchDecodePrintDisplayFrames},
+    {"parseFieldByField", benchParseFieldByField},
+    {"parseCommand", benchParseCommand},
+    {"decodeCommand", benchDecodeCommand},
+};
+
+//----------------------------------------------------------------------------
+void runBenchmarks(void (*emit)(const char* json)) {
+    EWireFormat savedFormat = Message::defaultFormat();
+    const EWireFormat formats[] = {WIRE_FORMAT_ASCII, WIRE_FORMAT_BINARY};
+    for (int f = 0; f < 2; ++f) {
+        for (unsigned i = 0; i < sizeof(s_benchCases) / sizeof(s_benchCases[0]); ++i) {
+            const BenchCase& bench = s_benchCases[i];
+            Message::setDefaultFormat(formats[f]);
+            uint64_t start = system_timer_current_time_us();
+            int bytes = bench.fn(BENCH_ITERATIONS);
+            uint64_t elapsedUs = system_timer_current_time_us() - start;
+            Message::setDefaultFormat(savedFormat);
+
+            int nsPerOp = (int)(elapsedUs * 1000 / BENCH_ITERATIONS);
+            ManagedString json = ManagedString("{\"bench\":\"") + bench.name +
+                                 "\",\"fmt\":\"" + (f ? "binary" : "ascii") +
+                                 "\",\"iters\":" + ManagedString(BENCH_ITERATIONS) +
+                                 ",\"ns\":" + ManagedString(nsPerOp) +
+                                 ",\"bytes\":" + ManagedString(bytes) + "}";
+            emit(json.toCharArray());
+        }
+    }
+}
+
+#endif  // KODU_BENCHMARKS
@@ -0,0 +1,21 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Set to 1 to build the Message codec benchmarks into the firmware. They are
+// run on request by CMD_RUN_BENCHMARKS and cost flash, so release builds
+// leave them out.
+#ifndef KODU_BENCHMARKS
+#define KODU_BENCHMARKS 0
+#endif
+
+#if KODU_BENCHMARKS
+
+// Times each Message primitive and full-message encode/decode in both wire
+// formats. Each result is passed to emit as a single-line JSON object:
+//   {"bench":"readU16Hex","fmt":"ascii","iters":500,"ns":2140,"bytes":5}
+// where ns is nanoseconds per op and bytes is wire bytes per op.
+void runBenchmarks(void (*emit)(const char* json));
+
+#endif  // KODU_BENCHMARKS
+
+#endif  // BENCHMARK_H
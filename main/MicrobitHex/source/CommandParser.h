@@ -0,0 +1,58 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <stdint.h>
+
+#include "Message.h"
+
+// Decodes a command's fields in one pass, each typed by the variable it is
+// read into:
+//
+//   uint8_t pin;
+//   uint16_t value;
+//   if (parseCommand(msg, CMD_SET_PIN_SERVO_VALUE, pin, value)) ...
+//
+// uint8_t is a byte, uint16_t a word, uint32_t a dword, char a single char,
+// ManagedString a String and MicroBitImage an Image, as in the protocol
+// comments in Main.cpp. Parsing stops at the first field that is missing or
+// malformed.
+
+inline bool parseField(const Message& msg, uint8_t& value) {
+    return msg.readU8Hex(value);
+}
+
+inline bool parseField(const Message& msg, uint16_t& value) {
+    return msg.readU16Hex(value);
+}
+
+inline bool parseField(const Message& msg, uint32_t& value) {
+    return msg.readU32Hex(value);
+}
+
+inline bool parseField(const Message& msg, char& value) {
+    return msg.readChar(value);
+}
+
+inline bool parseField(const Message& msg, ManagedString& value) {
+    return msg.readString(value);
+}
+
+inline bool parseField(const Message& msg, MicroBitImage& value) {
+    return msg.readImage(value);
+}
+
+inline bool parseFields(const Message&) {
+    return true;
+}
+
+template <typename Field, typename... Fields>
+bool parseFields(const Message& msg, Field& field, Fields&... fields) {
+    return parseField(msg, field) && parseFields(msg, fields...);
+}
+
+template <typename... Fields>
+bool parseCommand(const Message& msg, char opcode, Fields&... fields) {
+    return msg.consume(opcode) && parseFields(msg, fields...);
+}
+
+#endif  // COMMAND_PARSER_H
@@ -0,0 +1,131 @@
+#include "CommandQueue.h"
+
+#include <stddef.h>
+
+//============================================================================
+
+//----------------------------------------------------------------------------
+static char opcode(const Message& msg) {
+    return msg.length() ? msg.charBuffer()[0] : 0;
+}
+
+//----------------------------------------------------------------------------
+CommandQueue::CommandQueue(int depth, EQueuePolicy policy) {
+    for (int i = 0; i <= COMMAND_QUEUE_MAX_DEPTH; ++i) {
+        this->order[i] = i;
+    }
+    this->count = 0;
+    this->running = false;
+    this->dropped = 0;
+    this->depth = 0;
+    this->configure(depth, policy);
+}
+
+//----------------------------------------------------------------------------
+void CommandQueue::configure(int depth, EQueuePolicy policy) {
+    if (depth > COMMAND_QUEUE_MAX_DEPTH)
+        depth = COMMAND_QUEUE_MAX_DEPTH;
+    this->depth = depth;
+    this->policy = policy;
+    // Shrinking drops the oldest waiting commands, but never the one that
+    // is about to start.
+    while (this->pending() > this->depth && this->pending() > (this->running ? 0 : 1)) {
+        this->removeAt(this->firstPending());
+        this->dropped++;
+    }
+}
+
+//----------------------------------------------------------------------------
+bool CommandQueue::push(Message& msg) {
+    int first = this->firstPending();
+    if (this->policy == QUEUE_POLICY_COALESCE) {
+        for (int i = first; i < this->count; ++i) {
+            Message& slot = this->slots[this->order[i]];
+            if (opcode(slot) == opcode(msg)) {
+                slot.take(msg);
+                if (slot.length())
+                    return true;
+                // Pool exhausted; the stale command is gone either way.
+                this->removeAt(i);
+                return false;
+            }
+        }
+    }
+    // An idle queue always takes a command, even at depth 0: it runs at once
+    // rather than waiting.
+    if (this->count && this->pending() >= this->depth) {
+        if (this->policy == QUEUE_POLICY_REJECT || this->depth == 0)
+            return false;
+        this->removeAt(first);
+        this->dropped++;
+    }
+    Message& slot = this->slots[this->order[this->count]];
+    slot.take(msg);
+    if (!slot.length()) {
+        slot.release();
+        return false;
+    }
+    this->count++;
+    return true;
+}
+
+//----------------------------------------------------------------------------
+void CommandQueue::clearPending() {
+    while (this->pending() > 0) {
+        this->removeAt(this->firstPending());
+    }
+}
+
+//----------------------------------------------------------------------------
+int CommandQueue::pending() const {
+    return this->count - this->firstPending();
+}
+
+//----------------------------------------------------------------------------
+uint16_t CommandQueue::droppedCount() const {
+    return this->dropped;
+}
+
+//----------------------------------------------------------------------------
+void CommandQueue::resetDroppedCount() {
+    this->dropped = 0;
+}
+
+//----------------------------------------------------------------------------
+Message* CommandQueue::begin() {
+    if (this->count == 0)
+        return NULL;
+    this->running = true;
+    Message* msg = &this->slots[this->order[0]];
+    msg->rewind();
+    return msg;
+}
+
+//----------------------------------------------------------------------------
+void CommandQueue::end() {
+    if (!this->running)
+        return;
+    this->running = false;
+    this->removeAt(0);
+}
+
+//----------------------------------------------------------------------------
+bool CommandQueue::busy() const {
+    return this->running;
+}
+
+//----------------------------------------------------------------------------
+int CommandQueue::firstPending() const {
+    return (this->running && this->count) ? 1 : 0;
+}
+
+//----------------------------------------------------------------------------
+void CommandQueue::removeAt(int index) {
+    uint8_t slot = this->order[index];
+    this->slots[slot].release();
+    for (int i = index; i < this->count - 1; ++i) {
+        this->order[i] = this->order[i + 1];
+    }
+    this->order[this->count - 1] = slot;
+    this->count--;
+}
@@ -0,0 +1,58 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <stdint.h>
+
+#include "Message.h"
+
+// Upper bound on commands waiting behind the one being run.
+#define COMMAND_QUEUE_MAX_DEPTH 3
+
+// What push does when the queue is already at its configured depth.
+enum EQueuePolicy {
+    // Refuse the new command.
+    QUEUE_POLICY_REJECT = 0,
+    // Discard the oldest waiting command to make room.
+    QUEUE_POLICY_DROP_OLDEST = 1,
+    // A new command replaces a waiting one with the same opcode. Otherwise
+    // behaves like QUEUE_POLICY_DROP_OLDEST.
+    QUEUE_POLICY_COALESCE = 2,
+};
+
+// A bounded FIFO of commands for a single worker. A pushed command's buffer
+// is taken over when the caller owns it, and copied otherwise. The worker
+// takes the front command with begin() and keeps it in place until end(),
+// so it is never overwritten while running.
+class CommandQueue {
+   public:
+    CommandQueue(int depth, EQueuePolicy policy);
+
+    void configure(int depth, EQueuePolicy policy);
+    bool push(Message& msg);
+    void clearPending();
+    int pending() const;
+    uint16_t droppedCount() const;
+    void resetDroppedCount();
+
+    // Worker side
+    Message* begin();
+    void end();
+    // Whether the worker is between begin() and end().
+    bool busy() const;
+
+   private:
+    Message slots[COMMAND_QUEUE_MAX_DEPTH + 1];
+    // A permutation of slot indices: the first count are queued, oldest
+    // first, and the rest are free.
+    uint8_t order[COMMAND_QUEUE_MAX_DEPTH + 1];
+    uint8_t count;
+    uint8_t depth;
+    bool running;
+    EQueuePolicy policy;
+    uint16_t dropped;
+
+    int firstPending() const;
+    void removeAt(int index);
+};
+
+#endif  // COMMAND_QUEUE_H
@@ -0,0 +1,232 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CommandParser.h"
+#include "Message.h"
+
+// The fixed fields of every command Kodu sends, in wire order, declared
+// once. Each list below turns into a struct, Cmd<Name>, with one member per
+// field:
+//
+//   CmdSetPinServoValue cmd;
+//   if (decodeCommand(msg, cmd)) ... cmd.pin ... cmd.value
+//
+// The firmware decodes commands into these structs, host tools encode them
+// with encodeCommand(), and host/SchemaMain.cpp generates Kodu's C# writers
+// from the same lists, so the two ends can't disagree about field order or
+// size. Repeated and optional parts (image lists, tones, a ping's wire
+// format, ...) follow the fixed fields, and each handler reads them itself;
+// the protocol comments in Main.cpp describe them.
+//
+// A field is F(type, name), with types as in CommandParser.h.
+
+#define CMD_SCROLL_IMAGES_FIELDS(F) F(uint16_t, delayMs) F(uint8_t, brightness) F(uint8_t, count)
+#define CMD_PRINT_IMAGES_FIELDS(F) F(uint16_t, durationMs) F(uint8_t, brightness) F(uint8_t, count)
+#define CMD_SCROLL_TEXT_FIELDS(F) F(uint16_t, delayMs) F(uint8_t, brightness) F(ManagedString, text)
+#define CMD_PRINT_TEXT_FIELDS(F) F(uint16_t, durationMs) F(uint8_t, brightness) F(ManagedString, text)
+#define CMD_CONFIG_INPUT_PIN_FIELDS(F) F(uint8_t, pin) F(uint8_t, pinMode)
+#define CMD_SET_PIN_VALUE_FIELDS(F) F(uint8_t, pin) F(uint8_t, pinMode) F(uint16_t, value)
+#define CMD_SET_PIN_SERVO_VALUE_FIELDS(F) F(uint8_t, pin) F(uint16_t, value)
+#define CMD_PLAY_TONES_FIELDS(F) F(uint8_t, pin) F(uint16_t, durationMs) F(uint8_t, count)
+#define CMD_SET_PIXEL_FIELDS(F) F(uint8_t, x) F(uint8_t, y) F(uint8_t, brightness)
+#define CMD_PRINT_DISPLAY_FRAMES_FIELDS(F) F(uint8_t, count)
+#define CMD_SET_PIN_PWM_OUT_FIELDS(F) \
+    F(uint8_t, pin) F(uint16_t, frequencyHz) F(uint16_t, frequencyMultiplier) F(uint16_t, dutyCycle)
+#define CMD_RUN_BENCHMARKS_FIELDS(F)
+#define CMD_CONFIG_DISPLAY_QUEUE_FIELDS(F) F(uint8_t, depth) F(uint8_t, policy)
+#define CMD_CONFIG_TELEMETRY_FIELDS(F) F(uint8_t, rateHz) F(uint8_t, policy) F(uint8_t, windowSecs)
+#define CMD_CONFIG_DELTA_FIELDS(F) \
+    F(uint8_t, keyframeTicks) F(uint16_t, deadbandX) F(uint16_t, deadbandY) F(uint16_t, deadbandZ)
+#define CMD_PING_FIELDS(F)
+#define CMD_BATCH_FIELDS(F) F(uint8_t, count)
+#define CMD_SHOW_ICON_FIELDS(F) F(uint8_t, icon) F(uint8_t, brightness)
+#define CMD_START_FIELDS(F)
+#define CMD_PLAY_MELODY_FIELDS(F) F(uint8_t, pin) F(uint8_t, melody)
+#define CMD_CACHE_FRAMES_FIELDS(F) F(uint8_t, slot) F(uint8_t, count) F(uint8_t, delta)
+#define CMD_PLAY_CACHED_FRAMES_FIELDS(F) \
+    F(uint16_t, durationMs) F(uint8_t, brightness) F(uint8_t, loops) F(uint8_t, count)
+#define CMD_CONFIG_EVENTS_FIELDS(F) F(uint8_t, header)
+#define CMD_GET_STATS_FIELDS(F)
+#define CMD_CONFIG_ACCEL_FIELDS(F) F(uint8_t, periodMs) F(uint8_t, filter) F(uint8_t, strength) F(uint8_t, tilt)
+#define CMD_CONFIG_COMPASS_FIELDS(F) F(uint8_t, heading)
+#define CMD_RELIABLE_FIELDS(F) F(uint8_t, seq) F(uint16_t, crc)
+#define CMD_UPLOAD_BEGIN_FIELDS(F) F(uint16_t, length)
+#define CMD_UPLOAD_CHUNK_FIELDS(F) F(uint16_t, offset)
+#define CMD_UPLOAD_COMMIT_FIELDS(F)
+#define CMD_CAPTURE_ANALOG_FIELDS(F)                                                                         \
+    F(uint8_t, pin) F(uint16_t, periodUs) F(uint8_t, decimation) F(uint8_t, trigger) F(uint16_t, level) \
+        F(uint16_t, preTrigger) F(uint16_t, count)
+
+// Every command: X(ID, Name, opcode), ID naming both CMD_<ID> in Main.cpp's
+// EProtocol and the field list above.
+#define KODU_COMMANDS(X)                              \
+    X(SCROLL_IMAGES, ScrollImages, 'A')               \
+    X(PRINT_IMAGES, PrintImages, 'B')                 \
+    X(SCROLL_TEXT, ScrollText, 'C')                   \
+    X(PRINT_TEXT, PrintText, 'D')                     \
+    X(CONFIG_INPUT_PIN, ConfigInputPin, 'E')          \
+    X(SET_PIN_VALUE, SetPinValue, 'F')                \
+    X(SET_PIN_SERVO_VALUE, SetPinServoValue, 'G')     \
+    X(PLAY_TONES, PlayTones, 'H')                     \
+    X(SET_PIXEL, SetPixel, 'I')                       \
+    X(PRINT_DISPLAY_FRAMES, PrintDisplayFrames, 'J')  \
+    X(SET_PIN_PWM_OUT, SetPinPwmOut, 'K')             \
+    X(RUN_BENCHMARKS, RunBenchmarks, 'L')             \
+    X(CONFIG_DISPLAY_QUEUE, ConfigDisplayQueue, 'M')  \
+    X(CONFIG_TELEMETRY, ConfigTelemetry, 'N')         \
+    X(CONFIG_DELTA, ConfigDelta, 'O')                 \
+    X(PING, Ping, 'P')                                \
+    X(BATCH, Batch, 'Q')                              \
+    X(SHOW_ICON, ShowIcon, 'R')                       \
+    X(START, Start, 'S')                              \
+    X(PLAY_MELODY, PlayMelody, 'T')                   \
+    X(CACHE_FRAMES, CacheFrames, 'U')                 \
+    X(PLAY_CACHED_FRAMES, PlayCachedFrames, 'V')      \
+    X(CONFIG_EVENTS, ConfigEvents, 'W')               \
+    X(GET_STATS, GetStats, 'X')                       \
+    X(CONFIG_ACCEL, ConfigAccel, 'Y')                 \
+    X(CONFIG_COMPASS, ConfigCompass, 'Z')             \
+    X(RELIABLE, Reliable, '#')                        \
+    X(UPLOAD_BEGIN, UploadBegin, '<')                 \
+    X(UPLOAD_CHUNK, UploadChunk, '+')                 \
+    X(UPLOAD_COMMIT, UploadCommit, '>')               \
+    X(CAPTURE_ANALOG, CaptureAnalog, '~')
+
+//============================================================================
+// Field types
+
+enum EFieldKind {
+    FIELD_END = 0,
+    FIELD_BYTE,
+    FIELD_WORD,
+    FIELD_DWORD,
+    FIELD_STRING,
+};
+
+template <typename T>
+struct FieldKind;
+template <>
+struct FieldKind<uint8_t> {
+    static constexpr EFieldKind value = FIELD_BYTE;
+};
+template <>
+struct FieldKind<uint16_t> {
+    static constexpr EFieldKind value = FIELD_WORD;
+};
+template <>
+struct FieldKind<uint32_t> {
+    static constexpr EFieldKind value = FIELD_DWORD;
+};
+template <>
+struct FieldKind<ManagedString> {
+    static constexpr EFieldKind value = FIELD_STRING;
+};
+
+// A command's field kinds as a compile-time list, ending in void.
+template <typename... Types>
+struct FieldList;
+template <>
+struct FieldList<void> {
+    static constexpr int count = 0;
+    static constexpr EFieldKind kind(int) { return FIELD_END; }
+};
+template <typename T, typename... Rest>
+struct FieldList<T, Rest...> {
+    static constexpr int count = 1 + FieldList<Rest...>::count;
+    static constexpr EFieldKind kind(int i) { return i == 0 ? FieldKind<T>::value : FieldList<Rest...>::kind(i - 1); }
+};
+
+//============================================================================
+// Command structs
+
+#define COMMAND_FIELD_MEMBER(type, name) type name;
+#define COMMAND_FIELD_TYPE(type, name) type,
+#define COMMAND_FIELD_VISIT(type, name) &&visitor(#name, this->name)
+
+#define DECLARE_COMMAND(ID, Name, op)                                             \
+    struct Cmd##Name {                                                            \
+        static constexpr char opcode = op;                                        \
+        typedef FieldList<CMD_##ID##_FIELDS(COMMAND_FIELD_TYPE) void> Fields;     \
+        static const char* name() { return #Name; }                               \
+        CMD_##ID##_FIELDS(COMMAND_FIELD_MEMBER)                                   \
+        template <typename Visitor>                                               \
+        bool visit(Visitor& visitor) {                                            \
+            (void)visitor;                                                        \
+            return true CMD_##ID##_FIELDS(COMMAND_FIELD_VISIT);                   \
+        }                                                                         \
+        template <typename Visitor>                                               \
+        bool visit(Visitor& visitor) const {                                      \
+            (void)visitor;                                                        \
+            return true CMD_##ID##_FIELDS(COMMAND_FIELD_VISIT);                   \
+        }                                                                         \
+    };
+
+KODU_COMMANDS(DECLARE_COMMAND)
+
+#undef DECLARE_COMMAND
+
+//============================================================================
+// Decoding and encoding
+
+struct FieldDecoder {
+    const Message& msg;
+    int decoded;
+
+    template <typename T>
+    bool operator()(const char*, T& value) {
+        if (!parseField(this->msg, value))
+            return false;
+        ++this->decoded;
+        return true;
+    }
+};
+
+// Reads cmd's opcode and fixed fields, stopping at the first one that is
+// missing or malformed. decoded, if given, is set to how many fields were
+// read, so a handler can still use the ones before a bad one.
+template <typename Command>
+bool decodeCommand(const Message& msg, Command& cmd, int* decoded = NULL) {
+    FieldDecoder decoder = {msg, 0};
+    bool ok = msg.consume(Command::opcode) && cmd.visit(decoder);
+    if (decoded)
+        *decoded = decoder.decoded;
+    return ok;
+}
+
+inline bool encodeField(Message& msg, uint8_t value) {
+    return msg.writeU8Hex(value);
+}
+
+inline bool encodeField(Message& msg, uint16_t value) {
+    return msg.writeU16Hex(value);
+}
+
+inline bool encodeField(Message& msg, uint32_t value) {
+    return msg.writeU32Hex(value);
+}
+
+inline bool encodeField(Message& msg, const ManagedString& value) {
+    return msg.writeStringField(value.toCharArray(), value.length());
+}
+
+struct FieldEncoder {
+    Message& msg;
+
+    template <typename T>
+    bool operator()(const char*, const T& value) {
+        return encodeField(this->msg, value);
+    }
+};
+
+// Writes cmd's opcode and fixed fields, for host tools and tests. Any
+// repeated or optional part is then written after it.
+template <typename Command>
+bool encodeCommand(Message& msg, const Command& cmd) {
+    FieldEncoder encoder = {msg};
+    return msg.writeChar(Command::opcode) && cmd.visit(encoder);
+}
+
+#endif  // COMMANDS_H
@@ -0,0 +1,76 @@
+#include "Framing.h"
+
+//============================================================================
+
+//----------------------------------------------------------------------------
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF).
+uint16_t crc16(const uint8_t* data, int length) {
+    uint16_t crc = 0xFFFF;
+    while (length-- > 0) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+//----------------------------------------------------------------------------
+int frameEncode(uint8_t* block, int payloadLength) {
+    if (payloadLength < 0 || payloadLength > FRAME_MAX_PAYLOAD)
+        return 0;
+
+    // Length and crc around the payload.
+    block[1] = (uint8_t)payloadLength;
+    uint16_t crc = crc16(block + 1, payloadLength + 1);
+    block[FRAME_HEADER_SIZE + payloadLength] = (crc >> 8) & 0xFF;
+    block[FRAME_HEADER_SIZE + payloadLength + 1] = crc & 0xFF;
+
+    // COBS: block[0] is the first code byte, and each zero in the data is
+    // replaced with the distance to the next one.
+    int dataEnd = payloadLength + 4;
+    int code = 0;
+    for (int i = 1; i < dataEnd; ++i) {
+        if (block[i] == 0) {
+            block[code] = (uint8_t)(i - code);
+            code = i;
+        }
+    }
+    block[code] = (uint8_t)(dataEnd - code);
+    block[dataEnd] = FRAME_DELIMITER;
+
+    return dataEnd + 1;
+}
+
+//----------------------------------------------------------------------------
+bool frameDecode(uint8_t* buf, int length, uint8_t*& payload, int& payloadLength) {
+    if (length > 0 && buf[length - 1] == FRAME_DELIMITER)
+        --length;
+
+    // Undo COBS. Output never overtakes input so this is safe in place.
+    int r = 0;
+    int w = 0;
+    while (r < length) {
+        uint8_t code = buf[r++];
+        if (code == 0)
+            return false;
+        for (int i = 1; i < code; ++i) {
+            if (r >= length || buf[r] == 0)
+                return false;
+            buf[w++] = buf[r++];
+        }
+        if (code < 0xFF && r < length)
+            buf[w++] = 0;
+    }
+
+    // <length:byte><payload><crc:word>
+    if (w < 3 || buf[0] != w - 3)
+        return false;
+    uint16_t crc = (buf[w - 2] << 8) | buf[w - 1];
+    if (crc != crc16(buf, w - 2))
+        return false;
+
+    payload = buf + 1;
+    payloadLength = buf[0];
+    return true;
+}
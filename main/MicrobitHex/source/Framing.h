@@ -0,0 +1,38 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <stdint.h>
+
+// Binary wire frames.
+//
+// A frame carries one message payload. Before stuffing, it is laid out as
+// <length:byte><payload:byte[length]><crc:word>, where crc is CRC-16/CCITT
+// over the length byte and payload. The whole thing is then COBS-encoded so
+// the only zero byte on the wire is the trailing frame delimiter.
+
+#define FRAME_VERSION 1
+
+// Bytes reserved ahead of the payload in an encode buffer: the COBS code byte
+// and the length byte.
+#define FRAME_HEADER_SIZE 2
+// Total bytes a frame adds to its payload: header, crc and delimiter.
+#define FRAME_OVERHEAD (FRAME_HEADER_SIZE + 3)
+// Keeps every COBS run under 254 bytes so frames can be stuffed in place.
+#define FRAME_MAX_PAYLOAD 250
+
+#define FRAME_DELIMITER 0
+
+uint16_t crc16(const uint8_t* data, int length);
+
+// Encodes the frame in place. The payload must already be stored at
+// block + FRAME_HEADER_SIZE, and the block must have room for
+// FRAME_OVERHEAD extra bytes. Returns the number of bytes to send, or 0 if
+// the payload is too large.
+int frameEncode(uint8_t* block, int payloadLength);
+
+// Decodes a received frame in place. The delimiter may be included or
+// already stripped. On success, returns true and points payload and
+// payloadLength at the verified payload within buf.
+bool frameDecode(uint8_t* buf, int length, uint8_t*& payload, int& payloadLength);
+
+#endif  // FRAMING_H
@@ -0,0 +1,76 @@
+// Generated by CodeGenUtil from Icons.cs. Do not edit.
+
+#ifndef ICONS_H
+#define ICONS_H
+
+#include <stdint.h>
+
+enum EIcon {
+    ICON_HEART = 0,
+    ICON_SMALL_HEART = 1,
+    ICON_HAPPY = 2,
+    ICON_SAD = 3,
+    ICON_CONFUSED = 4,
+    ICON_ANGRY = 5,
+    ICON_ASLEEP = 6,
+    ICON_SURPRISED = 7,
+    ICON_SILLY = 8,
+    ICON_FABULOUS = 9,
+    ICON_MEH = 10,
+    ICON_YES = 11,
+    ICON_NO = 12,
+    ICON_CHECKERBOARD = 13,
+    ICON_DIAMOND = 14,
+    ICON_SMALL_DIAMOND = 15,
+    ICON_SQUARE = 16,
+    ICON_SMALL_SQUARE = 17,
+    ICON_DOT = 18,
+    ICON_SCISSORS = 19,
+    ICON_UP_ARROW = 20,
+    ICON_UP_RIGHT_ARROW = 21,
+    ICON_RIGHT_ARROW = 22,
+    ICON_DOWN_RIGHT_ARROW = 23,
+    ICON_DOWN_ARROW = 24,
+    ICON_DOWN_LEFT_ARROW = 25,
+    ICON_LEFT_ARROW = 26,
+    ICON_UP_LEFT_ARROW = 27,
+    ICON_BLOCK = 28,
+    ICON_BLANK = 29,
+    ICON_COUNT = 30,
+};
+
+// One byte per row, top row first; bit 4 is the leftmost column.
+static constexpr uint8_t s_icons[ICON_COUNT][5] = {
+    {0x0A, 0x1F, 0x1F, 0x0E, 0x04},  // Heart
+    {0x00, 0x0A, 0x0E, 0x04, 0x00},  // SmallHeart
+    {0x00, 0x0A, 0x00, 0x11, 0x0E},  // Happy
+    {0x00, 0x0A, 0x00, 0x0E, 0x11},  // Sad
+    {0x00, 0x0A, 0x00, 0x0A, 0x15},  // Confused
+    {0x11, 0x0A, 0x00, 0x1F, 0x15},  // Angry
+    {0x00, 0x1B, 0x00, 0x0E, 0x00},  // Asleep
+    {0x0A, 0x00, 0x04, 0x0A, 0x04},  // Surprised
+    {0x11, 0x00, 0x1F, 0x03, 0x03},  // Silly
+    {0x1F, 0x1B, 0x00, 0x0A, 0x0E},  // Fabulous
+    {0x1B, 0x00, 0x02, 0x04, 0x08},  // Meh
+    {0x00, 0x01, 0x02, 0x14, 0x08},  // Yes
+    {0x11, 0x0A, 0x04, 0x0A, 0x11},  // No
+    {0x15, 0x0A, 0x15, 0x0A, 0x15},  // Checkerboard
+    {0x04, 0x0A, 0x11, 0x0A, 0x04},  // Diamond
+    {0x00, 0x04, 0x0A, 0x04, 0x00},  // SmallDiamond
+    {0x1F, 0x11, 0x11, 0x11, 0x1F},  // Square
+    {0x00, 0x0E, 0x0A, 0x0E, 0x00},  // SmallSquare
+    {0x00, 0x00, 0x04, 0x00, 0x00},  // Dot
+    {0x19, 0x1A, 0x04, 0x1A, 0x19},  // Scissors
+    {0x04, 0x0E, 0x15, 0x04, 0x04},  // UpArrow
+    {0x07, 0x03, 0x05, 0x08, 0x10},  // UpRightArrow
+    {0x04, 0x02, 0x1F, 0x02, 0x04},  // RightArrow
+    {0x10, 0x08, 0x05, 0x03, 0x07},  // DownRightArrow
+    {0x04, 0x04, 0x15, 0x0E, 0x04},  // DownArrow
+    {0x01, 0x02, 0x14, 0x18, 0x1C},  // DownLeftArrow
+    {0x04, 0x08, 0x1F, 0x08, 0x04},  // LeftArrow
+    {0x1C, 0x18, 0x14, 0x02, 0x01},  // UpLeftArrow
+    {0x1F, 0x1F, 0x1F, 0x1F, 0x1F},  // Block
+    {0x00, 0x00, 0x00, 0x00, 0x00},  // Blank
+};
+
+#endif  // ICONS_H
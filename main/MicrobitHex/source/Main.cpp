@@ -1,37 +1,176 @@
 #include "MicroBit.h"
 #include "MicroBitCompat.h"
 #include "Message.h"
+#include "CommandParser.h"
+#include "Commands.h"
+#include "CommandQueue.h"
+#include "MessagePool.h"
+#include "Framing.h"
+#include "Benchmark.h"
+#include "Icons.h"
+#include "Melodies.h"
+#include "Sequencer.h"
+#include "AccelFilter.h"
+#include "TxScheduler.h"
+#include "AnalogCapture.h"
 
 //============================================================================
 
 #define KODU_MICROBIT_VERSION 4
 
+// Sampled state defaults; CMD_CONFIG_TELEMETRY changes them at runtime.
 #define SAMPLED_STATE_HZ 10
 #define SAMPLED_STATE_SECS 5
-#define SAMPLED_STATE_ITERATIONS (SAMPLED_STATE_HZ * SAMPLED_STATE_SECS)
+#define SAMPLED_STATE_MAX_HZ 100
+// In on-change mode, unchanged state is still resent this often.
+#define SAMPLED_STATE_KEEPALIVE_MS 1000
+// Max doublings of the send period while the TX buffer is backed up.
+#define SAMPLED_STATE_MAX_BACKOFF 3
+// Three input pins, pitch and roll, and the event header in text.
+#define SAMPLED_STATE_MAX_LENGTH 96
 
-#define INIT_CHECKED_STATE() bool ReadOk = true
-#define CHECKED_READ(cond)        \
-    if (ReadOk && !(cond)) {      \
-        errmsg("ERR_PARSE", msg); \
-        ReadOk = false;           \
-    }
-#define CHECKED_ACTION(action) \
-    if (ReadOk) {              \
-        (action);              \
-    }
-#define READ_OK() ReadOk
+#define SERIAL_RX_BUFFER_SIZE 128
+
+// Display commands that may wait behind the one being shown, by default.
+#define DISPLAY_QUEUE_DEPTH 2
+
+// Frames kept on the device for CMD_PLAY_CACHED_FRAMES.
+#define FRAME_CACHE_SLOTS 8
+// Most slots one CMD_PLAY_CACHED_FRAMES can list.
+#define PLAY_FRAMES_MAX_COUNT 32
+
+// Longest the sequencer fiber sleeps while anything is playing.
+#define SEQUENCER_MAX_SLEEP_MS 10
+
+// Message bus ids for Kodu's own events, above the range used by the DAL.
+#define KODU_ID_DISPLAY_QUEUE 9001
+#define KODU_ID_SEQUENCER 9002
+#define KODU_ID_ORIENTATION 9003
+#define KODU_ID_TX 9004
+#define KODU_ID_CAPTURE 9005
+#define KODU_EVT_QUEUED 1
+
+// Longest command that can be uploaded in chunks.
+#define UPLOAD_MAX_LENGTH 512
+// An upload being played while it arrives is abandoned after this long
+// without a chunk.
+#define UPLOAD_TIMEOUT_MS 2000
+// How often a display command waiting on an upload checks for more.
+#define UPLOAD_POLL_MS 10
+// How often the compass calibration checks whether the display op it
+// stopped has ended.
+#define DISPLAY_POLL_MS 10
+
+// How often the TX fiber checks for room while a message waits, and how
+// often a producer of several messages checks for queue space.
+#define TX_POLL_MS 2
 
-#define PIN_COUNT 21
+// Fastest analog capture: each conversion takes tens of microseconds in the
+// timer interrupt, so this leaves most of the CPU for everything else.
+#define CAPTURE_MIN_PERIOD_US 200
+// Samples per EVT_CAPTURE_BLOCK, so each fits the TX buffer even as ASCII.
+#define CAPTURE_BLOCK_SAMPLES 32
+#define CAPTURE_BLOCK_LENGTH 112
+
+// Sequence numbers of reliable commands remembered for spotting resends.
+#define RELIABLE_WINDOW 8
+
+// Storage key for the compass calibration, so it survives a reboot.
+#define COMPASS_CALIBRATION_KEY "koduCompassCal"
+
+// Commands are the letters 'A' to 'Z'.
+#define COMMAND_COUNT 26
+// Opcodes listed per EVT_STATS_COMMANDS event, so each fits the TX buffer.
+#define STATS_OPCODES_PER_EVENT 8
+
+// Health counters, reported and reset by CMD_GET_STATS.
+struct KoduStats {
+    uint32_t txBytes;
+    uint16_t txStalls;
+    uint16_t parseErrors;
+    uint16_t displayBusy;
+    uint16_t tonesPreempted;
+    uint16_t dispatched[COMMAND_COUNT];
+    uint16_t maxDispatchUs[COMMAND_COUNT];
+};
+
+// One sample of the state sent in EVT_SAMPLED_STATE.
+struct SampledState {
+    uint8_t buttons[2];
+    int16_t acc[3];
+    int16_t tilt[2];  // pitch and roll, when CMD_CONFIG_ACCEL turns them on
+    bool hasHeading;  // once CMD_CONFIG_COMPASS has a calibrated heading
+    uint16_t heading;
+    char pinMode[3];  // 'a' or 'd' for input pins, 0 otherwise
+    uint16_t pinValue[3];
+};
 
 //============================================================================
 
 static MicroBit s_ubit;
-static volatile int s_sendStateIterations;
-static volatile bool s_displayBusy;
+static volatile unsigned long s_sampledStateDeadlineMs;
+static uint16_t s_sampledStatePeriodMs = 1000 / SAMPLED_STATE_HZ;
+static unsigned long s_sampledStateWindowMs = SAMPLED_STATE_SECS * 1000;
+static uint8_t s_sampledStatePolicy;
+static uint8_t s_sampledStateBackoff;
+static SampledState s_sentState;
+static bool s_sentStateValid;
+static unsigned long s_sentStateMs;
+static uint8_t s_deltaKeyframeTicks;
+static uint8_t s_ticksSinceKeyframe;
+static uint16_t s_accDeadband[3];
+static AccelFilter s_accelFilter;
+static bool s_sendTilt;
+static volatile bool s_headingSubscribed;
+static volatile bool s_headingValid;
+static volatile uint16_t s_heading;
+static bool s_orientationFiberStarted;
+static uint8_t s_reliableSeqs[RELIABLE_WINDOW];
+static uint8_t s_reliableCount;
+static uint8_t s_reliableNext;
+static char s_uploadBuffer[UPLOAD_MAX_LENGTH];
+static uint16_t s_uploadLength;
+static volatile uint16_t s_uploadReceived;
+static volatile unsigned long s_uploadChunkMs;
+static volatile uint8_t s_uploadState;
+static uint8_t s_uploadId;    // tells a placeholder for an old upload from the current one
+static bool s_uploadStarted;  // a display op was queued for this upload
+static bool s_uploadDone;     // and has finished
+static bool s_uploadRunning;  // the display worker is reading the upload
+static bool s_uploadDispatching;  // a committed upload is being run in place
+static bool s_eventHeader;
+static KoduStats s_stats;
+// The next opcode the EVT_STATS_COMMANDS pages of the last CMD_GET_STATS
+// will list, or COMMAND_COUNT once they have all been queued.
+static int s_statsNextOpcode = COMMAND_COUNT;
+static bool s_statsReset;
+void sendStatsPages();
+static bool s_benchmarksRunning;
+static uint8_t s_eventSeq;
+static TxScheduler s_tx;
+static AnalogCapture s_capture;
+static Ticker s_captureTicker;
+static MicroBitPin* volatile s_capturePin;
+// Each analog input's last conversion. Sampled state repeats it while a
+// capture has the ADC.
+static uint16_t s_analogHeld[3];
+static uint8_t s_pinEdges[3];
+static uint8_t s_captureId;
+static bool s_captureFiberStarted;
+void stopCapture();
 static volatile int s_buttonState[2] = {MICROBIT_BUTTON_EVT_UP, MICROBIT_BUTTON_EVT_UP};
-static volatile bool s_pinsBusy[PIN_COUNT];
-static Message s_displayOpMsg;
+static CommandQueue s_displayQueue(DISPLAY_QUEUE_DEPTH, QUEUE_POLICY_REJECT);
+// Cuts the running display op short at its next frame.
+static bool s_displayStop;
+// The compass calibration has the display. The worker waits, and commands
+// that draw directly draw into the held image, shown once it is over.
+static bool s_displayHeld;
+static int s_heldBrightness;
+static MicroBitImage s_heldImage;
+void stopDisplayOp();
+void setPinTone(int pinId, uint16_t frequency);
+static Sequencer s_sequencer(setPinTone);
+static uint8_t s_frameCache[FRAME_CACHE_SLOTS][25];
 
 //============================================================================
 // Protocol
@@ -39,8 +178,11 @@ static Message s_displayOpMsg;
 enum EProtocol {
     //------------------------------------------------------------------------
     // COMMANDS - Sent from Kodu
+    //
+    // An Image is five packed rows of on/off bits, or a greyscale image; see
+    // Message::readImage.
 
-    // P
+    // P[<wireFormat:byte>[<hostTimeUs:dword>]]
     CMD_PING = 'P',
     // S
     CMD_START = 'S',
@@ -52,7 +194,8 @@ enum EProtocol {
     CMD_SCROLL_TEXT = 'C',
     // D<durationMs:word><brightness:byte><str:String>
     CMD_PRINT_TEXT = 'D',
-    // E<pin:byte><pinMode:byte>[<pullMode:byte>]
+    // E<pin:byte><pinMode:byte>[<pullMode:byte>[<edges:byte>]], edges being
+    // an EPinEdges
     CMD_CONFIG_INPUT_PIN = 'E',
     // F<pin:byte><mode:byte><value:word>
     CMD_SET_PIN_VALUE = 'F',
@@ -66,30 +209,242 @@ enum EProtocol {
     CMD_PRINT_DISPLAY_FRAMES = 'J',
     // K<pin:byte><frequencyHz:word><frequencyMultiplier:word><dutyCycle:word>
     CMD_SET_PIN_PWM_OUT = 'K',
+    // L - replies with EVT_SYSMSG JSON lines; needs KODU_BENCHMARKS
+    CMD_RUN_BENCHMARKS = 'L',
+    // M<depth:byte><policy:byte>
+    CMD_CONFIG_DISPLAY_QUEUE = 'M',
+    // N<rateHz:byte><policy:byte><windowSecs:byte>
+    CMD_CONFIG_TELEMETRY = 'N',
+    // O<keyframeTicks:byte><deadbandX:word><deadbandY:word><deadbandZ:word>
+    CMD_CONFIG_DELTA = 'O',
+    // Q<count:byte><cmd:String>[<cmd:String>...]
+    CMD_BATCH = 'Q',
+    // R<icon:byte><brightness:byte>, icon being an EIcon
+    CMD_SHOW_ICON = 'R',
+    // T<pin:byte><melody:byte>[<loops:byte><bpm:byte>], melody being an
+    // EMelody. loops of 0 repeats until replaced.
+    CMD_PLAY_MELODY = 'T',
+    // U<slot:byte><count:byte><delta:byte><img:Image>[<img:Image>...]
+    CMD_CACHE_FRAMES = 'U',
+    // V<durationMs:word><brightness:byte><loops:byte><count:byte><slot:byte>[<slot:byte>...]
+    // loops of 0 repeats until another display command is queued.
+    CMD_PLAY_CACHED_FRAMES = 'V',
+    // W<header:byte>
+    CMD_CONFIG_EVENTS = 'W',
+    // X[<reset:byte>] - replies with EVT_STATS and EVT_STATS_COMMANDS
+    CMD_GET_STATS = 'X',
+    // Y<periodMs:byte><filter:byte><strength:byte><tilt:byte>, filter being
+    // an EAccelFilter. periodMs of 0 leaves the sample period as it is.
+    CMD_CONFIG_ACCEL = 'Y',
+    // Z<heading:byte>[<recalibrate:byte>]
+    CMD_CONFIG_COMPASS = 'Z',
+    // #<seq:byte><crc:word><cmd:String> - runs cmd at most once and replies
+    // with EVT_ACK, or EVT_NACK if it arrived damaged. crc is the
+    // CRC-16/CCITT-FALSE of cmd's bytes, as in Framing.h.
+    CMD_RELIABLE = '#',
+    // <<length:word> - starts uploading a command of length bytes in chunks
+    CMD_UPLOAD_BEGIN = '<',
+    // +<offset:word><data:String> - the upload's bytes from offset on
+    CMD_UPLOAD_CHUNK = '+',
+    // > - runs the uploaded command, once all of it has arrived
+    CMD_UPLOAD_COMMIT = '>',
+    // ~<pin:byte><periodUs:word><decimation:byte><trigger:byte><level:word><preTrigger:word><count:word>
+    // Captures count samples, each the average of decimation conversions
+    // taken periodUs apart, and replies with EVT_CAPTURE_BLOCKs. trigger is
+    // an ECaptureTrigger. count of 0 stops a capture.
+    CMD_CAPTURE_ANALOG = '~',
 
     //------------------------------------------------------------------------
     // EVENTS - Sent to Kodu
+    //
+    // With the event header on (CMD_CONFIG_EVENTS), input events (a, b, c,
+    // e and f) carry <seq:byte><timeUs:dword> right after the event letter:
+    // a rolling sequence number, so gaps show dropped events, and when the
+    // input happened in microseconds since boot, modulo 2^32.
 
     // m<str:chars>
     EVT_SYSMSG = 'm',
-    // p<version:byte>
+    // p<version:byte>[<wireFormat:byte>[<hostTimeUs:dword><deviceTimeUs:dword>]]
     EVT_PING_REPLY = 'p',
     // a<button:byte><state:byte>
     EVT_BUTTON_STATE = 'a',
     // b<gesture:byte>
     EVT_ACCEL_GESTURE = 'b',
+    // e<pin:byte><value:byte> - a digital input changed to value, as picked
+    // by CMD_CONFIG_INPUT_PIN's edges
+    EVT_PIN_EDGE = 'e',
     // ca<accX:word><accY:word><accZ:word><pitch:word><roll:word>c<heading:word>p<count:byte><state:PinState>[<state:PinState>...]
+    // Binary: c<sections:byte> followed by the present sections, untagged.
+    // pitch and roll are only sent when CMD_CONFIG_ACCEL turns them on, and
+    // are flagged by SECTION_TILT in binary frames. The c section is only
+    // sent once CMD_CONFIG_COMPASS has a calibrated heading.
     EVT_SAMPLED_STATE = 'c',
+    // f<fields:byte>[<buttonA:byte>][<buttonB:byte>][<accX:word>][<accY:word>][<accZ:word>][<pin0:PinDelta>][<pin1:PinDelta>][<pin2:PinDelta>]
+    // PinDelta is <mode:char><value:word>, mode being 'a', 'd' or '-' for
+    // no longer an input.
+    EVT_SAMPLED_STATE_DELTA = 'f',
+    // g<txBytes:dword><txStalls:word><parseErrors:word><displayBusy:word><displayDropped:word><tonesPreempted:word>
+    //  <poolInUse:byte><poolHighWater:byte><poolExhausted:word><toneNotes:dword><toneMaxLateMs:word>
+    EVT_STATS = 'g',
+    // h<count:byte>[<opcode:char><dispatched:word><maxDispatchUs:word>...]
+    // Only opcodes dispatched since the last reset are listed.
+    EVT_STATS_COMMANDS = 'h',
+    // k<seq:byte> - a CMD_RELIABLE was run, or had already been
+    EVT_ACK = 'k',
+    // n<seq:byte><reason:byte>, reason being an ENackReason
+    EVT_NACK = 'n',
+    // s<capture:byte><first:word><count:word><triggerIndex:word><samples:Bytes>
+    // Samples first on of a capture of count, packed 10 bits each, most
+    // significant first. Bytes is a length byte and then the bytes, as hex
+    // pairs in ASCII. capture changes with every capture started.
+    EVT_CAPTURE_BLOCK = 's',
+};
+
+// Commands.h declares each command's fields; its opcodes must match these.
+#define CHECK_COMMAND_OPCODE(ID, Name, op) static_assert(Cmd##Name::opcode == CMD_##ID, "opcode of Cmd" #Name);
+KODU_COMMANDS(CHECK_COMMAND_OPCODE)
+#undef CHECK_COMMAND_OPCODE
+
+// Digital input changes sent as EVT_PIN_EDGE.
+enum EPinEdges {
+    PIN_EDGE_NONE = 0,
+    PIN_EDGE_RISE = 1,
+    PIN_EDGE_FALL = 2,
+    PIN_EDGE_BOTH = 3,
+};
+
+// Where an upload is. Image lists start playing while still RECEIVING.
+enum EUploadState {
+    UPLOAD_IDLE = 0,
+    UPLOAD_RECEIVING = 1,
+    UPLOAD_COMMITTED = 2,
+};
+
+// Why a CMD_RELIABLE was refused. It wasn't run, so resending it is safe.
+enum ENackReason {
+    NACK_PARSE = 0,
+    NACK_CHECKSUM = 1,
+    NACK_NESTED = 2,
+    // The display queue was full.
+    NACK_BUSY = 3,
+    // The command reported an error other than ERR_PARSE, e.g. ERR_ARGUMENT.
+    NACK_REFUSED = 4,
+};
+
+// How dispatch went, from the errors the handler reported. Display commands
+// only report whether they could be queued.
+enum EDispatchResult {
+    DISPATCH_OK = 0,
+    DISPATCH_PARSE_ERROR = 1,
+    DISPATCH_BUSY = 2,
+    DISPATCH_REFUSED = 3,
+};
+
+static EDispatchResult s_dispatchResult;
+
+// When EVT_SAMPLED_STATE is streamed.
+enum ETelemetryPolicy {
+    // For windowSecs after each received command. The original behavior.
+    TELEMETRY_WINDOWED = 0,
+    // Always.
+    TELEMETRY_CONTINUOUS = 1,
+    // Always sampled, but only sent when it differs from the last one sent.
+    TELEMETRY_ON_CHANGE = 2,
+};
+
+// Fields of EVT_SAMPLED_STATE_DELTA.
+enum ESampledStateField {
+    FIELD_BUTTON_A = 0x01,
+    FIELD_BUTTON_B = 0x02,
+    FIELD_ACC_X = 0x04,
+    FIELD_ACC_Y = 0x08,
+    FIELD_ACC_Z = 0x10,
+    FIELD_PIN_0 = 0x20,
+    FIELD_PIN_1 = 0x40,
+    FIELD_PIN_2 = 0x80,
+};
+
+// Sections of EVT_SAMPLED_STATE, as flagged in binary frames.
+enum ESampledStateSection {
+    SECTION_BUTTONS = 0x01,
+    SECTION_ACCEL = 0x02,
+    SECTION_COMPASS = 0x04,
+    SECTION_PINS = 0x08,
+    // Pitch and roll follow the accelerometer axes.
+    SECTION_TILT = 0x10,
 };
 
 //============================================================================
 
+//----------------------------------------------------------------------------
+// Hands msg to the TX fiber. Never blocks: returns false if msg was dropped
+// because too many of its class are already waiting.
+bool sendMessage(Message& msg, ETxPriority priority) {
+    bool replacing = priority == TX_PRIORITY_TELEMETRY && s_tx.pending(priority);
+    bool queued = s_tx.push(msg, priority);
+    if (!queued || replacing) {
+        s_stats.txStalls++;
+    }
+    if (queued) {
+        MicroBitEvent(KODU_ID_TX, KODU_EVT_QUEUED);
+    }
+    return queued;
+}
+
+//----------------------------------------------------------------------------
+// For background fibers that send several messages in a row: waits for
+// queue space instead of dropping. Only the calling fiber waits, so the
+// receive fiber never calls this. A message that got no
+// buffer from the pool can never be queued, so it is dropped and counted.
+bool sendMessageInTurn(Message& msg, ETxPriority priority) {
+    if (!msg.length()) {
+        s_stats.txStalls++;
+        return false;
+    }
+    while (!s_tx.push(msg, priority)) {
+        fiber_sleep(TX_POLL_MS);
+    }
+    MicroBitEvent(KODU_ID_TX, KODU_EVT_QUEUED);
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// The only writer to the serial port. A message only goes into the TX
+// buffer once all of it fits, so a more urgent one queued meanwhile still
+// goes first.
+void txFiber() {
+    while (1) {
+        Message* next = s_tx.peek();
+        if (!next) {
+            fiber_wait_for_event(KODU_ID_TX, KODU_EVT_QUEUED);
+            continue;
+        }
+        int length = next->finalize();
+        int room = s_ubit.serial.getTxBufferSize() - s_ubit.serial.txBufferedSize() - 1;
+        bool oversized = length >= s_ubit.serial.getTxBufferSize();
+        if (length > room && !oversized) {
+            fiber_sleep(TX_POLL_MS);
+            continue;
+        }
+        Message msg;
+        s_tx.pop(msg);
+        if (length) {
+            // Only a message bigger than the whole buffer waits here.
+            s_ubit.serial.send(msg.byteBuffer(), length, oversized ? SYNC_SLEEP : ASYNC);
+            s_stats.txBytes += length;
+        }
+        // A slot may have come free for the stats pages still to go.
+        sendStatsPages();
+    }
+    release_fiber();
+}
+
 //----------------------------------------------------------------------------
 void sysmsg(const char* str) {
     Message msg(40);
     msg.writeChar(EVT_SYSMSG);
     msg.writeString(str, true);
-    s_ubit.serial.send(msg.byteBuffer(), msg.finalize());
+    sendMessage(msg, TX_PRIORITY_DIAGNOSTIC);
 }
 
 //----------------------------------------------------------------------------
@@ -97,309 +452,628 @@ void sysmsg(const char* chars, int count) {
     Message msg(40);
     msg.writeChar(EVT_SYSMSG);
     msg.writeChars(chars, count, true);
-    s_ubit.serial.send(msg.byteBuffer(), msg.finalize());
+    sendMessage(msg, TX_PRIORITY_DIAGNOSTIC);
+}
+
+//----------------------------------------------------------------------------
+// Reports input that was dropped. Like every sysmsg it is dropped itself
+// when diagnostics are backed up, so a stream of serial noise can't stall
+// receiving or crowd out other events.
+void rxerrmsg(const char* err) {
+    Message msg(40);
+    msg.writeChar(EVT_SYSMSG);
+    msg.writeString(err, true);
+    sendMessage(msg, TX_PRIORITY_DIAGNOSTIC);
 }
 
 //----------------------------------------------------------------------------
+// Echoes the start of a rejected command.
 void errmsg(const char* err, Message& badmsg) {
     Message msg(40);
     msg.writeChar(EVT_SYSMSG);
     msg.writeString(err);
     msg.writeChars(badmsg.charBuffer(), badmsg.length(), true);
-    s_ubit.serial.send(msg.byteBuffer(), msg.finalize());
+    sendMessage(msg, TX_PRIORITY_DIAGNOSTIC);
+    if (s_dispatchResult == DISPATCH_OK) {
+        s_dispatchResult = DISPATCH_REFUSED;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Starts an input event, with the event header if it's on.
+void writeEvent(Message& msg, char evt, uint64_t timeUs) {
+    msg.writeChar(evt);
+    if (s_eventHeader) {
+        msg.writeU8Hex(s_eventSeq++);
+        msg.writeU32Hex((uint32_t)timeUs);
+    }
+}
+
+//----------------------------------------------------------------------------
+void parseError(Message& msg) {
+    s_stats.parseErrors++;
+    if (s_dispatchResult == DISPATCH_OK) {
+        s_dispatchResult = DISPATCH_PARSE_ERROR;
+    }
+    errmsg("ERR_PARSE", msg);
 }
 
 //----------------------------------------------------------------------------
-void onDisplayFree() {
-    s_displayBusy = false;
+// Reads a command's fixed fields (see Commands.h), reporting ERR_PARSE if
+// any is missing or malformed.
+template <typename Command>
+bool readCommand(Message& msg, Command& cmd) {
+    if (decodeCommand(msg, cmd)) {
+        return true;
+    }
+    parseError(msg);
+    return false;
 }
 
 //----------------------------------------------------------------------------
-void onPinFree(int pin) {
-    if (pin < PIN_COUNT) {
-        s_pinsBusy[pin] = false;
+// Reads the next fields of a command's repeated or optional part.
+template <typename... Fields>
+bool readFields(Message& msg, Fields&... fields) {
+    if (parseFields(msg, fields...)) {
+        return true;
     }
+    parseError(msg);
+    return false;
 }
 
 //----------------------------------------------------------------------------
-void onPing() {
+void onPing(Message& msg) {
+    // If the host asks for a wire format, it is acknowledged in the reply
+    // (sent in the current format) and takes effect right after it.
+    uint8_t format;
+    uint32_t hostTimeUs;
+    msg.consume(CMD_PING);
+    bool negotiate = msg.readU8Hex(format);
+    if (negotiate && format != WIRE_FORMAT_ASCII && format != WIRE_FORMAT_BINARY) {
+        format = WIRE_FORMAT_ASCII;
+    }
+    // A host timestamp is echoed with ours, for round-trip time and clock
+    // offset.
+    bool echo = negotiate && msg.readU32Hex(hostTimeUs);
     // Send a ping in reply including our version number.
-    Message msg(20);
-    msg.writeChar(EVT_PING_REPLY);
-    msg.writeU8Hex(KODU_MICROBIT_VERSION);
-    s_ubit.serial.send(msg.byteBuffer(), msg.finalize());
+    Message reply(30);
+    reply.writeChar(EVT_PING_REPLY);
+    reply.writeU8Hex(KODU_MICROBIT_VERSION);
+    if (negotiate) {
+        reply.writeU8Hex(format);
+    }
+    if (echo) {
+        reply.writeU32Hex(hostTimeUs);
+        reply.writeU32Hex((uint32_t)system_timer_current_time_us());
+    }
+    sendMessage(reply, TX_PRIORITY_REPLY);
+    if (negotiate) {
+        Message::setDefaultFormat((EWireFormat)format);
+    }
 }
 
 //----------------------------------------------------------------------------
-void onStart() {
+void onStart(Message&) {
     // Reset to initial state.
+    stopCapture();
+    for (int i = 0; i < 3; ++i) {
+        if (s_pinEdges[i]) {
+            s_ubit.io.pin[i].eventOn(MICROBIT_PIN_EVENT_NONE);
+            s_pinEdges[i] = PIN_EDGE_NONE;
+        }
+    }
     s_ubit.io.pin[0].setDigitalValue(0);
     s_ubit.io.pin[0].setDigitalValue(1);
     s_ubit.io.pin[0].setDigitalValue(2);
-    s_ubit.display.setBrightness(255);
-    s_ubit.display.image.clear();
-    s_displayBusy = false;
-    for (int i = 0; i < PIN_COUNT; ++i) s_pinsBusy[i] = false;
+    s_displayQueue.clearPending();
+    stopDisplayOp();
+    if (s_displayHeld) {
+        s_heldBrightness = 255;
+        s_heldImage.clear();
+    } else {
+        s_ubit.display.setBrightness(255);
+        s_ubit.display.image.clear();
+    }
+    memset(s_frameCache, 0, sizeof(s_frameCache));
+    s_sequencer.stopAll();
     s_buttonState[0] = MICROBIT_BUTTON_EVT_UP;
     s_buttonState[1] = MICROBIT_BUTTON_EVT_UP;
+    s_eventHeader = false;
+    s_reliableCount = 0;
+    s_uploadState = UPLOAD_IDLE;
+    ++s_uploadId;
+    // A host starting over may not know what it negotiated before, so the
+    // reply is already ASCII.
+    Message::setDefaultFormat(WIRE_FORMAT_ASCII);
     // Send a ping in reply including our version number.
     Message msg(20);
     msg.writeChar(EVT_PING_REPLY);
     msg.writeU8Hex(KODU_MICROBIT_VERSION);
-    s_ubit.serial.send(msg.byteBuffer(), msg.finalize());
+    sendMessage(msg, TX_PRIORITY_REPLY);
 }
 
 //----------------------------------------------------------------------------
-void scrollImagesFiber() {
-    INIT_CHECKED_STATE();
-    Message& msg = s_displayOpMsg;
-    uint16_t delayMs;
-    uint8_t brightness;
-    uint8_t imageCount;
-    CHECKED_READ(msg.consume(CMD_SCROLL_IMAGES));
-    CHECKED_READ(msg.readU16Hex(delayMs));
-    CHECKED_READ(msg.readU8Hex(brightness));
-    CHECKED_READ(msg.readU8Hex(imageCount));
-    if (READ_OK()) {
-        s_ubit.display.setBrightness(brightness);
-        s_ubit.display.image.clear();
-        MicroBitImage image;
-        while (READ_OK() && imageCount--) {
-            CHECKED_READ(msg.readImage(image));
-            CHECKED_ACTION(s_ubit.display.scroll(image, delayMs));
-        }
+void scrollImages(Message& msg) {
+    CmdScrollImages cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    s_ubit.display.setBrightness(cmd.brightness);
+    s_ubit.display.image.clear();
+    MicroBitImage image;
+    while (cmd.count-- && !s_displayStop && readFields(msg, image)) {
+        s_ubit.display.scroll(image, cmd.delayMs);
     }
-    onDisplayFree();
-    release_fiber();
 }
 
 //----------------------------------------------------------------------------
-void printImagesFiber() {
-    INIT_CHECKED_STATE();
-    Message& msg = s_displayOpMsg;
+void printImages(Message& msg) {
+    CmdPrintImages cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    s_ubit.display.setBrightness(cmd.brightness);
+    s_ubit.display.image.clear();
+    MicroBitImage image;
+    while (cmd.count-- > 0 && !s_displayStop && readFields(msg, image)) {
+        s_ubit.display.print(image, 0, 0, 0, cmd.durationMs);
+    }
+}
+
+//----------------------------------------------------------------------------
+void printDisplayFrames(Message& msg) {
+    CmdPrintDisplayFrames cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    s_ubit.display.image.clear();
     uint16_t durationMs;
     uint8_t brightness;
-    uint8_t count;
-    CHECKED_READ(msg.consume(CMD_PRINT_IMAGES));
-    CHECKED_READ(msg.readU16Hex(durationMs));
-    CHECKED_READ(msg.readU8Hex(brightness));
-    CHECKED_READ(msg.readU8Hex(count));
-    if (READ_OK()) {
+    MicroBitImage image;
+    while (cmd.count-- > 0 && !s_displayStop && readFields(msg, durationMs, brightness, image)) {
         s_ubit.display.setBrightness(brightness);
-        s_ubit.display.image.clear();
-        MicroBitImage image;
-        while (READ_OK() && count-- > 0) {
-            CHECKED_READ(msg.readImage(image));
-            CHECKED_ACTION(s_ubit.display.print(image, 0, 0, 0, durationMs));
+        s_ubit.display.print(image, 0, 0, 0, durationMs);
+        if (durationMs > 0) {
+            s_ubit.display.image.clear();
         }
     }
-    onDisplayFree();
-    release_fiber();
 }
 
 //----------------------------------------------------------------------------
-void printDisplayFramesFiber() {
-    INIT_CHECKED_STATE();
-    Message& msg = s_displayOpMsg;
+void scrollText(Message& msg) {
+    CmdScrollText cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    s_ubit.display.image.clear();
+    if (cmd.text.length()) {
+        s_ubit.display.setBrightness(cmd.brightness);
+        s_ubit.display.scroll(cmd.text, cmd.delayMs);
+    }
+}
+
+//----------------------------------------------------------------------------
+void printText(Message& msg) {
+    CmdPrintText cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    s_ubit.display.image.clear();
+    if (cmd.text.length()) {
+        s_ubit.display.setBrightness(cmd.brightness);
+        s_ubit.display.print(cmd.text, cmd.durationMs);
+    }
+}
+
+//----------------------------------------------------------------------------
+void showIcon(Message& msg) {
+    CmdShowIcon cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    if (cmd.icon >= ICON_COUNT) {
+        return errmsg("ERR_ARGUMENT:icon", msg);
+    }
+    uint8_t pixels[25];
+    for (int y = 0; y < 5; ++y) {
+        for (int x = 0; x < 5; ++x) {
+            pixels[y * 5 + (4 - x)] = (s_icons[cmd.icon][y] & (1 << x)) ? 255 : 0;
+        }
+    }
+    s_ubit.display.setBrightness(cmd.brightness);
+    s_ubit.display.print(MicroBitImage(5, 5, pixels));
+}
+
+//----------------------------------------------------------------------------
+void playCachedFrames(Message& msg) {
+    CmdPlayCachedFrames cmd;
+    uint8_t slots[PLAY_FRAMES_MAX_COUNT];
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    if (cmd.count > PLAY_FRAMES_MAX_COUNT) {
+        return errmsg("ERR_ARGUMENT:count", msg);
+    }
+    // Looping forever through frames that take no time never yields.
+    if (cmd.loops == 0 && cmd.durationMs == 0) {
+        return errmsg("ERR_ARGUMENT:durationMs", msg);
+    }
+    for (int i = 0; i < cmd.count; ++i) {
+        if (!readFields(msg, slots[i])) {
+            return;
+        }
+        if (slots[i] >= FRAME_CACHE_SLOTS) {
+            return errmsg("ERR_ARGUMENT:slot", msg);
+        }
+    }
+    if (!cmd.count) {
+        return;
+    }
+    s_ubit.display.setBrightness(cmd.brightness);
+    // Each frame replaces the last, with no blank frame in between.
+    do {
+        for (int i = 0; i < cmd.count && !s_displayStop; ++i) {
+            s_ubit.display.print(MicroBitImage(5, 5, s_frameCache[slots[i]]), 0, 0, 0, cmd.durationMs);
+        }
+        // print() only sleeps for a nonzero duration.
+        if (!cmd.durationMs) {
+            fiber_sleep(1);
+        }
+    } while ((cmd.loops == 0 || --cmd.loops > 0) && !s_displayQueue.pending() && !s_displayStop);
+}
+
+//----------------------------------------------------------------------------
+// Commands run by the display worker.
+bool isDisplayCommand(char opcode) {
+    switch (opcode) {
+        case CMD_SCROLL_IMAGES:
+        case CMD_PRINT_IMAGES:
+        case CMD_PRINT_DISPLAY_FRAMES:
+        case CMD_SCROLL_TEXT:
+        case CMD_PRINT_TEXT:
+        case CMD_SHOW_ICON:
+        case CMD_PLAY_CACHED_FRAMES:
+            return true;
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------
+// Display commands that can be played from an upload before it's complete.
+bool isImageListCommand(char opcode) {
+    return opcode == CMD_SCROLL_IMAGES || opcode == CMD_PRINT_IMAGES || opcode == CMD_PRINT_DISPLAY_FRAMES;
+}
+
+//----------------------------------------------------------------------------
+// Reads the next fields of the upload from offset, waiting for the chunks
+// that hold them if they haven't arrived yet.
+template <typename... Fields>
+bool readUploadFields(int& offset, Fields&... fields) {
+    while (1) {
+        Message view(s_uploadBuffer + offset, s_uploadReceived - offset);
+        if (parseFields(view, fields...)) {
+            offset += view.length() - view.bytesRemaining();
+            return true;
+        }
+        if (s_uploadState != UPLOAD_RECEIVING || s_displayStop) {
+            return false;
+        }
+        if (system_timer_current_time() - s_uploadChunkMs > UPLOAD_TIMEOUT_MS) {
+            s_uploadState = UPLOAD_IDLE;
+            sysmsg("ERR_UPLOAD:timeout");
+            return false;
+        }
+        fiber_sleep(UPLOAD_POLL_MS);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Plays an uploaded image list frame by frame as it arrives, so the first
+// frames show while the rest are still on the wire.
+void playUploadedImages() {
+    int offset = 0;
+    char opcode;
+    uint16_t timeMs = 0;
+    uint8_t brightness = 255;
     uint8_t count;
-    CHECKED_READ(msg.consume(CMD_PRINT_DISPLAY_FRAMES));
-    CHECKED_READ(msg.readU8Hex(count));
-    CHECKED_ACTION(s_ubit.display.image.clear());
-    while (READ_OK() && count-- > 0) {
-        uint16_t durationMs;
-        uint8_t brightness;
-        MicroBitImage image;
-        CHECKED_READ(msg.readU16Hex(durationMs));
-        CHECKED_READ(msg.readU8Hex(brightness));
-        CHECKED_READ(msg.readImage(image));
-        if (READ_OK()) {
-            s_ubit.display.setBrightness(brightness);
-            s_ubit.display.print(image, 0, 0, 0, durationMs);
-            if (durationMs > 0) {
-                CHECKED_ACTION(s_ubit.display.image.clear());
+    bool header = s_uploadBuffer[0] == CMD_PRINT_DISPLAY_FRAMES
+                      ? readUploadFields(offset, opcode, count)
+                      : readUploadFields(offset, opcode, timeMs, brightness, count);
+    if (!header) {
+        if (s_displayStop) {
+            return;
+        }
+        Message upload(s_uploadBuffer, s_uploadReceived);
+        return parseError(upload);
+    }
+    s_ubit.display.setBrightness(brightness);
+    s_ubit.display.image.clear();
+    MicroBitImage image;
+    while (count-- > 0 && !s_displayStop) {
+        bool ok = opcode == CMD_PRINT_DISPLAY_FRAMES ? readUploadFields(offset, timeMs, brightness, image)
+                                                      : readUploadFields(offset, image);
+        if (!ok) {
+            if (s_displayStop) {
+                return;
+            }
+            Message upload(s_uploadBuffer, s_uploadReceived);
+            return parseError(upload);
+        }
+        if (opcode == CMD_SCROLL_IMAGES) {
+            s_ubit.display.scroll(image, timeMs);
+        } else {
+            if (opcode == CMD_PRINT_DISPLAY_FRAMES) {
+                s_ubit.display.setBrightness(brightness);
+            }
+            s_ubit.display.print(image, 0, 0, 0, timeMs);
+            if (opcode == CMD_PRINT_DISPLAY_FRAMES && timeMs > 0) {
+                s_ubit.display.image.clear();
             }
         }
     }
-    onDisplayFree();
-    release_fiber();
 }
 
 //----------------------------------------------------------------------------
-void scrollTextFiber() {
-    INIT_CHECKED_STATE();
-    Message& msg = s_displayOpMsg;
-    uint16_t delayMs;
-    uint8_t brightness;
-    ManagedString str;
-    CHECKED_READ(msg.consume(CMD_SCROLL_TEXT));
-    CHECKED_READ(msg.readU16Hex(delayMs));
-    CHECKED_READ(msg.readU8Hex(brightness));
-    CHECKED_READ(msg.readString(str));
-    CHECKED_ACTION(s_ubit.display.image.clear());
-    if (READ_OK() && str.length()) {
-        s_ubit.display.setBrightness(brightness);
-        s_ubit.display.scroll(str, delayMs);
+void runDisplayOp(Message& msg);
+
+//----------------------------------------------------------------------------
+// Runs the display command held in the upload buffer, reading it in place.
+void runUploadedDisplayOp(Message& msg) {
+    uint8_t id;
+    if (!parseCommand(msg, CMD_UPLOAD_COMMIT, id) || id != s_uploadId) {
+        return;  // the upload was replaced or abandoned while this waited
+    }
+    s_uploadRunning = true;
+    if (isImageListCommand(s_uploadBuffer[0])) {
+        playUploadedImages();
+    } else {
+        Message upload(s_uploadBuffer, s_uploadReceived);
+        runDisplayOp(upload);
+    }
+    s_uploadRunning = false;
+    s_uploadDone = true;
+    if (s_uploadState == UPLOAD_COMMITTED) {
+        s_uploadState = UPLOAD_IDLE;
     }
-    onDisplayFree();
-    release_fiber();
 }
 
 //----------------------------------------------------------------------------
-void printTextFiber() {
-    INIT_CHECKED_STATE();
-    Message& msg = s_displayOpMsg;
-    uint16_t durationMs;
-    uint8_t brightness;
-    ManagedString str;
-    CHECKED_READ(msg.consume(CMD_PRINT_TEXT));
-    CHECKED_READ(msg.readU16Hex(durationMs));
-    CHECKED_READ(msg.readU8Hex(brightness));
-    CHECKED_READ(msg.readString(str));
-    CHECKED_ACTION(s_ubit.display.image.clear());
-    if (READ_OK() && str.length()) {
-        s_ubit.display.setBrightness(brightness);
-        s_ubit.display.print(str, durationMs);
+void runDisplayOp(Message& msg) {
+    char cmd = 0;
+    msg.readChar(cmd);
+    msg.rewind();
+
+    switch (cmd) {
+        case CMD_SCROLL_IMAGES:
+            return scrollImages(msg);
+        case CMD_PRINT_IMAGES:
+            return printImages(msg);
+        case CMD_PRINT_DISPLAY_FRAMES:
+            return printDisplayFrames(msg);
+        case CMD_SCROLL_TEXT:
+            return scrollText(msg);
+        case CMD_PRINT_TEXT:
+            return printText(msg);
+        case CMD_SHOW_ICON:
+            return showIcon(msg);
+        case CMD_PLAY_CACHED_FRAMES:
+            return playCachedFrames(msg);
+        case CMD_UPLOAD_COMMIT:
+            return runUploadedDisplayOp(msg);
+    }
+}
+
+//----------------------------------------------------------------------------
+void displayWorkerFiber() {
+    while (1) {
+        Message* msg = s_displayHeld ? NULL : s_displayQueue.begin();
+        if (!msg) {
+            fiber_wait_for_event(KODU_ID_DISPLAY_QUEUE, KODU_EVT_QUEUED);
+            continue;
+        }
+        s_displayStop = false;
+        runDisplayOp(*msg);
+        s_displayQueue.end();
     }
-    onDisplayFree();
     release_fiber();
 }
 
 //----------------------------------------------------------------------------
-void onScrollImages(Message& msg) {
-    if (s_displayBusy) {
-        sysmsg("ERR_DISPLAY_BUSY");
-        return;
+// Ends the running display op early: between frames, or right away for a
+// scroll or text.
+void stopDisplayOp() {
+    s_displayStop = true;
+    // While held, the only animation is the calibration's own prompt.
+    if (!s_displayHeld) {
+        s_ubit.display.stopAnimation();
     }
-    s_displayBusy = true;
-    s_displayOpMsg.copyFrom(msg);
-    create_fiber(scrollImagesFiber);
 }
 
 //----------------------------------------------------------------------------
-void onPrintImages(Message& msg) {
-    if (s_displayBusy) {
+// A command that is refused, or that pushes a waiting one out, stops the one
+// running, so an endless animation can't hold the display at any depth.
+bool queueDisplayOp(Message& msg) {
+    int waiting = s_displayQueue.pending();
+    if (!s_displayQueue.push(msg)) {
+        s_stats.displayBusy++;
         sysmsg("ERR_DISPLAY_BUSY");
-        return;
+        s_dispatchResult = DISPATCH_BUSY;
+        stopDisplayOp();
+        return false;
+    }
+    if (s_displayQueue.pending() <= waiting) {
+        stopDisplayOp();
     }
-    s_displayBusy = true;
-    s_displayOpMsg.copyFrom(msg);
-    create_fiber(printImagesFiber);
+    MicroBitEvent(KODU_ID_DISPLAY_QUEUE, KODU_EVT_QUEUED);
+    return true;
 }
 
 //----------------------------------------------------------------------------
-void onPrintDisplayFrames(Message& msg) {
-    if (s_displayBusy) {
-        sysmsg("ERR_DISPLAY_BUSY");
+void onDisplayOp(Message& msg) {
+    queueDisplayOp(msg);
+}
+
+//----------------------------------------------------------------------------
+// Stored right away rather than queued, so frames can be uploaded while an
+// animation plays.
+void onCacheFrames(Message& msg) {
+    CmdCacheFrames cmd;
+    if (!readCommand(msg, cmd)) {
         return;
     }
-    s_displayBusy = true;
-    s_displayOpMsg.copyFrom(msg);
-    create_fiber(printDisplayFramesFiber);
+    uint8_t slot = cmd.slot;
+    if (slot >= FRAME_CACHE_SLOTS || cmd.count > FRAME_CACHE_SLOTS - slot) {
+        return errmsg("ERR_ARGUMENT:slot", msg);
+    }
+    MicroBitImage image;
+    while (cmd.count--) {
+        if (!readFields(msg, image)) {
+            return;
+        }
+        uint8_t* frame = s_frameCache[slot];
+        memcpy(frame, image.getBitmap(), 25);
+        // A delta frame is XORed with the frame in the slot before it, the
+        // first slot's being blank. Greyscale levels stay levels under XOR.
+        if (cmd.delta && slot > 0) {
+            for (int i = 0; i < 25; ++i) {
+                frame[i] ^= s_frameCache[slot - 1][i];
+            }
+        }
+        slot++;
+    }
 }
 
 //----------------------------------------------------------------------------
-void onScrollText(Message& msg) {
-    if (s_displayBusy) {
-        sysmsg("ERR_DISPLAY_BUSY");
+void onConfigDisplayQueue(Message& msg) {
+    CmdConfigDisplayQueue cmd;
+    if (!readCommand(msg, cmd)) {
         return;
     }
-    s_displayBusy = true;
-    s_displayOpMsg.copyFrom(msg);
-    create_fiber(scrollTextFiber);
+    if (cmd.depth > COMMAND_QUEUE_MAX_DEPTH) {
+        return errmsg("ERR_ARGUMENT:depth", msg);
+    }
+    if (cmd.policy > QUEUE_POLICY_COALESCE) {
+        return errmsg("ERR_ARGUMENT:policy", msg);
+    }
+    s_displayQueue.configure(cmd.depth, (EQueuePolicy)cmd.policy);
 }
 
 //----------------------------------------------------------------------------
-void onPrintText(Message& msg) {
-    if (s_displayBusy) {
-        sysmsg("ERR_DISPLAY_BUSY");
-        return;
+// The capture interrupt reads its pin as analog input, so it must stop
+// before anything else changes that pin.
+void stopCapture() {
+    s_captureTicker.detach();
+    s_capture.stop();
+    s_capturePin = NULL;
+    ++s_captureId;
+}
+
+//----------------------------------------------------------------------------
+// Any new use of a pin ends its capture and its edge events.
+void releasePin(int pin) {
+    if (s_capturePin == &s_ubit.io.pin[pin]) {
+        stopCapture();
     }
-    s_displayBusy = true;
-    s_displayOpMsg.copyFrom(msg);
-    create_fiber(printTextFiber);
+    s_pinEdges[pin] = PIN_EDGE_NONE;
 }
 
 //----------------------------------------------------------------------------
 void onConfigInputPin(Message& msg) {
-    INIT_CHECKED_STATE();
-    // E|<pin:byte>|<pinMode:byte>[|<pullMode:byte>]
-    uint8_t pin;
-    uint8_t pinMode;
-    CHECKED_READ(msg.consume(CMD_CONFIG_INPUT_PIN));
-    CHECKED_READ(msg.readU8Hex(pin));
-    CHECKED_READ(msg.readU8Hex(pinMode));
+    // E|<pin:byte>|<pinMode:byte>[|<pullMode:byte>[|<edges:byte>]]
+    CmdConfigInputPin cmd;
+    uint8_t pullMode = 0;
+    uint8_t edges = PIN_EDGE_NONE;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    uint8_t pin = cmd.pin;
+    uint8_t pinMode = cmd.pinMode;
     if (pin > 2) {
         return errmsg("ERR_ARGUMENT:pin>2", msg);
     }
     if (pinMode == IO_STATUS_DIGITAL_IN) {
-        uint8_t pullMode;
-        CHECKED_READ(msg.readU8Hex(pullMode));
-        s_ubit.io.pin[pin].getDigitalValue((PinMode)pullMode);
-    } else if (pinMode == IO_STATUS_ANALOG_IN) {
-        s_ubit.io.pin[pin].getAnalogValue();
-    } else {
+        if (!readFields(msg, pullMode)) {
+            return;
+        }
+        // Edges are optional, but must be well formed when present.
+        if (msg.bytesRemaining() > 0 && !readFields(msg, edges)) {
+            return;
+        }
+        if (edges > PIN_EDGE_BOTH) {
+            return errmsg("ERR_ARGUMENT:edges", msg);
+        }
+    } else if (pinMode != IO_STATUS_ANALOG_IN) {
         return errmsg("ERR_ARGUMENT:pinMode", msg);
     }
+    releasePin(pin);
+    MicroBitPin& inputPin = s_ubit.io.pin[pin];
+    if (pinMode == IO_STATUS_ANALOG_IN) {
+        // Switching the pin converts, and a capture has the ADC to itself.
+        if (s_capturePin) {
+            stopCapture();
+        }
+        s_analogHeld[pin] = inputPin.getAnalogValue();
+        return;
+    }
+    // With edge events on, the DAL reads the pin through its interrupt
+    // instead, so drop that first when they're turned off.
+    inputPin.eventOn(MICROBIT_PIN_EVENT_NONE);
+    inputPin.getDigitalValue((PinMode)pullMode);
+    if (edges) {
+        inputPin.eventOn(MICROBIT_PIN_EVENT_ON_EDGE);
+        s_pinEdges[pin] = edges;
+    }
 }
 
 //----------------------------------------------------------------------------
 void onSetPinValue(Message& msg) {
-    INIT_CHECKED_STATE();
-    uint8_t pin;
-    uint8_t pinMode;
-    uint16_t pinValue;
-    CHECKED_READ(msg.consume(CMD_SET_PIN_VALUE));
-    CHECKED_READ(msg.readU8Hex(pin));
-    CHECKED_READ(msg.readU8Hex(pinMode));
-    CHECKED_READ(msg.readU16Hex(pinValue));
-    if (pin > 2) {
+    CmdSetPinValue cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    if (cmd.pin > 2) {
         return errmsg("ERR_ARGUMENT:pin>2", msg);
     }
-    if (READ_OK()) {
-        if (pinMode == IO_STATUS_DIGITAL_OUT) {
-            s_ubit.io.pin[pin].setDigitalValue(pinValue ? 1 : 0);
-        } else if (pinMode == IO_STATUS_ANALOG_OUT) {
-            if (pinValue > MICROBIT_PIN_MAX_OUTPUT) {
-                return errmsg("ERR_ARGUMENT:pinValue>1023", msg);
-            }
-            s_ubit.io.pin[pin].setAnalogValue(pinValue);
-        } else {
-            return errmsg("ERR_ARGUMENT:pinMode", msg);
+    releasePin(cmd.pin);
+    if (cmd.pinMode == IO_STATUS_DIGITAL_OUT) {
+        s_ubit.io.pin[cmd.pin].setDigitalValue(cmd.value ? 1 : 0);
+    } else if (cmd.pinMode == IO_STATUS_ANALOG_OUT) {
+        if (cmd.value > MICROBIT_PIN_MAX_OUTPUT) {
+            return errmsg("ERR_ARGUMENT:pinValue>1023", msg);
         }
+        s_ubit.io.pin[cmd.pin].setAnalogValue(cmd.value);
+    } else {
+        return errmsg("ERR_ARGUMENT:pinMode", msg);
     }
 }
 
 //----------------------------------------------------------------------------
 void onSetPinServoValue(Message& msg) {
-    INIT_CHECKED_STATE();
-    uint8_t pin;
-    uint16_t pinValue;
-    CHECKED_READ(msg.consume(CMD_SET_PIN_SERVO_VALUE));
-    CHECKED_READ(msg.readU8Hex(pin));
-    CHECKED_READ(msg.readU16Hex(pinValue));
-    if (pin > 2) {
-        return errmsg("ERR_ARGUMENT:pin>2", msg);
+    CmdSetPinServoValue cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
     }
-    if (READ_OK()) {
-        s_ubit.io.pin[pin].setServoValue(pinValue);
+    if (cmd.pin > 2) {
+        return errmsg("ERR_ARGUMENT:pin>2", msg);
     }
+    releasePin(cmd.pin);
+    s_ubit.io.pin[cmd.pin].setServoValue(cmd.value);
 }
 
 //----------------------------------------------------------------------------
 void onSetPinPwmOut(Message& msg) {
-    INIT_CHECKED_STATE();
-    uint8_t pin;
-    uint16_t frequencyHz;
-    uint16_t frequencyMultiplier;
-    uint16_t dutyCycle;
-    CHECKED_READ(msg.consume(CMD_SET_PIN_PWM_OUT));
-    CHECKED_READ(msg.readU8Hex(pin));
-    CHECKED_READ(msg.readU16Hex(frequencyHz));
-    CHECKED_READ(msg.readU16Hex(frequencyMultiplier));
-    CHECKED_READ(msg.readU16Hex(dutyCycle));
+    CmdSetPinPwmOut cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    uint8_t pin = cmd.pin;
+    uint16_t frequencyHz = cmd.frequencyHz;
+    uint16_t frequencyMultiplier = cmd.frequencyMultiplier;
+    uint16_t dutyCycle = cmd.dutyCycle;
     if (pin > 2) {
         return errmsg("ERR_ARGUMENT:pin>2", msg);
     }
+    releasePin(pin);
     if (dutyCycle > 1023) {
         return errmsg("ERR_ARGUMENT:dutyCycle>1023", msg);
     }
@@ -409,127 +1083,796 @@ void onSetPinPwmOut(Message& msg) {
     if (frequencyMultiplier == 0) {
         return errmsg("ERR_ARGUMENT:frequencyMultiplier==0", msg);
     }
-    if (READ_OK()) {
-        int periodUs = (int)(1000000.0f / (frequencyHz * frequencyMultiplier));
-        s_ubit.io.pin[pin].setAnalogValue(dutyCycle);
-        s_ubit.io.pin[pin].setAnalogPeriodUs(periodUs);
+    int periodUs = (int)(1000000.0f / (frequencyHz * frequencyMultiplier));
+    s_ubit.io.pin[pin].setAnalogValue(dutyCycle);
+    s_ubit.io.pin[pin].setAnalogPeriodUs(periodUs);
+}
+
+//----------------------------------------------------------------------------
+void setPinTone(int pinId, uint16_t frequency) {
+    releasePin(pinId);
+    MicroBitPin& pin = s_ubit.io.pin[pinId];
+    if (frequency) {
+        pin.setAnalogValue(512);
+        pin.setAnalogPeriodUs(1000000 / frequency);
+    } else {
+        pin.setAnalogValue(0);
     }
 }
 
 //----------------------------------------------------------------------------
-void playTonesFiber(void* param) {
-    INIT_CHECKED_STATE();
-    Message* pmsg = (Message*)param;
-    Message& msg = *pmsg;
-    uint8_t pinId;
-    CHECKED_READ(msg.consume(CMD_PLAY_TONES));
-    CHECKED_READ(msg.readU8Hex(pinId));
-    if (READ_OK()) {
-        if (pinId > 2) {
-            errmsg("ERR_ARGUMENT:pin", msg);
-        } else if (s_pinsBusy[pinId]) {
-            errmsg("ERR_PIN_BUSY", msg);
-        } else {
-            s_pinsBusy[pinId] = true;
-            uint16_t durationMs;
-            uint8_t count;
-            CHECKED_READ(msg.readU16Hex(durationMs));
-            CHECKED_READ(msg.readU8Hex(count));
-            MicroBitPin& pin = s_ubit.io.pin[pinId];
-            while (count--) {
-                uint16_t frequency;
-                CHECKED_READ(msg.readU16Hex(frequency));
-                if (!READ_OK())
-                    break;
-                pin.setAnalogValue(512);
-                pin.setAnalogPeriodUs(1000000 / frequency);
-                if (durationMs == 0)
-                    break;
-                fiber_sleep(durationMs);
-            }
-            if (durationMs) {
-                pin.setAnalogValue(0);
-            }
-            onPinFree(pinId);
+// Plays the notes due on every pin, sleeping until the next change. A track
+// started while asleep begins right away in its handler; this only picks up
+// its later notes, so the sleep is capped.
+void sequencerFiber() {
+    while (1) {
+        long waitMs = s_sequencer.update(system_timer_current_time());
+        if (waitMs < 0) {
+            fiber_wait_for_event(KODU_ID_SEQUENCER, KODU_EVT_QUEUED);
+            continue;
         }
+        fiber_sleep(waitMs < SEQUENCER_MAX_SLEEP_MS ? waitMs : SEQUENCER_MAX_SLEEP_MS);
     }
-    delete pmsg;
     release_fiber();
 }
 
 //----------------------------------------------------------------------------
 void onPlayTones(Message& msg) {
-    INIT_CHECKED_STATE();
-    uint8_t pinId = (uint8_t)-1;
-    CHECKED_READ(msg.consume(CMD_PLAY_TONES));
-    CHECKED_READ(msg.readU8Hex(pinId));
-    if (pinId > 2) {
-        errmsg("ERR_ARGUMENT:pin", msg);
+    CmdPlayTones cmd;
+    if (!readCommand(msg, cmd)) {
         return;
     }
-    if (s_pinsBusy[pinId]) {
-        sysmsg("ERR_PIN_BUSY");
-        return;
+    if (cmd.pin > 2) {
+        return errmsg("ERR_ARGUMENT:pin", msg);
     }
-    create_fiber(playTonesFiber, new Message(msg, true));
-}
-
-//----------------------------------------------------------------------------
-void onSetPixel(Message& msg) {
-    INIT_CHECKED_STATE();
-    uint8_t x, y, brightness;
-    CHECKED_READ(msg.consume(CMD_SET_PIXEL));
-    CHECKED_READ(msg.readU8Hex(x));
-    CHECKED_READ(msg.readU8Hex(y));
-    CHECKED_READ(msg.readU8Hex(brightness));
-    CHECKED_ACTION(s_ubit.display.image.setPixelValue(x, y, brightness));
+    if (cmd.count > SEQUENCER_MAX_NOTES) {
+        return errmsg("ERR_ARGUMENT:count", msg);
+    }
+    // A duration of 0 holds the first tone until replaced.
+    MelodyNote notes[SEQUENCER_MAX_NOTES];
+    for (int i = 0; i < cmd.count; ++i) {
+        notes[i].durationMs = cmd.durationMs;
+        if (!readFields(msg, notes[i].frequency)) {
+            return;
+        }
+    }
+    if (s_sequencer.playing(cmd.pin)) {
+        s_stats.tonesPreempted++;
+    }
+    s_sequencer.playCopy(cmd.pin, notes, cmd.count, 1, SEQUENCER_BASE_BPM, system_timer_current_time());
+    MicroBitEvent(KODU_ID_SEQUENCER, KODU_EVT_QUEUED);
 }
 
 //----------------------------------------------------------------------------
-void dispatchMessage(const char* buf, int length) {
-    Message msg(buf, length);
-    char cmd = 0;
-    msg.readChar(cmd);
-    msg.rewind();
+void onPlayMelody(Message& msg) {
+    CmdPlayMelody cmd;
+    uint8_t loops = 1;
+    uint8_t bpm = SEQUENCER_BASE_BPM;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    if (msg.readU8Hex(loops) && !readFields(msg, bpm)) {
+        return;
+    }
+    if (cmd.pin > 2) {
+        return errmsg("ERR_ARGUMENT:pin", msg);
+    }
+    if (cmd.melody >= MELODY_COUNT) {
+        return errmsg("ERR_ARGUMENT:melody", msg);
+    }
+    if (bpm == 0) {
+        return errmsg("ERR_ARGUMENT:bpm", msg);
+    }
+    if (s_sequencer.playing(cmd.pin)) {
+        s_stats.tonesPreempted++;
+    }
+    int start = s_melodyStarts[cmd.melody];
+    s_sequencer.play(cmd.pin, &s_melodyNotes[start], s_melodyStarts[cmd.melody + 1] - start, loops, bpm,
+                     system_timer_current_time());
+    MicroBitEvent(KODU_ID_SEQUENCER, KODU_EVT_QUEUED);
+}
+
+//----------------------------------------------------------------------------
+void onSetPixel(Message& msg) {
+    CmdSetPixel cmd;
+    if (readCommand(msg, cmd)) {
+        MicroBitImage& image = s_displayHeld ? s_heldImage : s_ubit.display.image;
+        image.setPixelValue(cmd.x, cmd.y, cmd.brightness);
+    }
+}
+
+#if KODU_BENCHMARKS
+//----------------------------------------------------------------------------
+// Called between benchmarks on their own fiber, which is the only one that
+// waits for room, so no result is dropped and nothing else is held up.
+void sendBenchmarkResult(const char* json) {
+    while (s_tx.full(TX_PRIORITY_DIAGNOSTIC)) {
+        fiber_sleep(TX_POLL_MS);
+    }
+    Message msg(100);
+    msg.writeChar(EVT_SYSMSG);
+    msg.writeString(json, true);
+    sendMessage(msg, TX_PRIORITY_DIAGNOSTIC);
+}
+
+//----------------------------------------------------------------------------
+void benchmarkFiber() {
+    runBenchmarks(sendBenchmarkResult);
+    s_benchmarksRunning = false;
+    release_fiber();
+}
+#endif
+
+//----------------------------------------------------------------------------
+// The benchmarks run for seconds, so they get a fiber of their own and the
+// receive fiber carries on.
+void onRunBenchmarks(Message&) {
+#if KODU_BENCHMARKS
+    if (s_benchmarksRunning) {
+        return sysmsg("ERR_BUSY");
+    }
+    s_benchmarksRunning = true;
+    create_fiber(benchmarkFiber);
+#else
+    sysmsg("ERR_UNSUPPORTED");
+#endif
+}
+
+//----------------------------------------------------------------------------
+void onConfigTelemetry(Message& msg) {
+    CmdConfigTelemetry cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    if (cmd.rateHz > SAMPLED_STATE_MAX_HZ) {
+        return errmsg("ERR_ARGUMENT:rateHz>100", msg);
+    }
+    if (cmd.policy > TELEMETRY_ON_CHANGE) {
+        return errmsg("ERR_ARGUMENT:policy", msg);
+    }
+    // A rate of zero stops the stream.
+    s_sampledStatePeriodMs = cmd.rateHz ? 1000 / cmd.rateHz : 0;
+    s_sampledStatePolicy = cmd.policy;
+    s_sampledStateWindowMs = cmd.windowSecs * 1000;
+    s_sampledStateBackoff = 0;
+    s_sentStateValid = false;
+}
+
+//----------------------------------------------------------------------------
+void onConfigDelta(Message& msg) {
+    CmdConfigDelta cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    s_deltaKeyframeTicks = cmd.keyframeTicks;
+    s_accDeadband[0] = cmd.deadbandX;
+    s_accDeadband[1] = cmd.deadbandY;
+    s_accDeadband[2] = cmd.deadbandZ;
+    // Start over with a keyframe.
+    s_sentStateValid = false;
+}
+
+//----------------------------------------------------------------------------
+void onConfigEvents(Message& msg) {
+    CmdConfigEvents cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    s_eventHeader = cmd.header != 0;
+    s_eventSeq = 0;
+}
+
+//----------------------------------------------------------------------------
+void onConfigAccel(Message& msg) {
+    CmdConfigAccel cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    if (!s_accelFilter.configure((EAccelFilter)cmd.filter, cmd.strength)) {
+        return errmsg("ERR_ARGUMENT:filter", msg);
+    }
+    // The DAL rounds to the nearest period the sensor supports.
+    if (cmd.periodMs) {
+        s_ubit.accelerometer.setPeriod(cmd.periodMs);
+    }
+    s_sendTilt = cmd.tilt != 0;
+    s_sentStateValid = false;
+}
+
+//----------------------------------------------------------------------------
+// Restores the calibration saved by an earlier session, if there is one.
+bool loadCompassCalibration() {
+    KeyValuePair* saved = s_ubit.storage.get(COMPASS_CALIBRATION_KEY);
+    if (!saved) {
+        return false;
+    }
+    CompassCalibration calibration;
+    memcpy(&calibration, saved->value, sizeof(calibration));
+    delete saved;
+    s_ubit.compass.setCalibration(calibration);
+    return true;
+}
+
+//----------------------------------------------------------------------------
+void saveCompassCalibration() {
+    static_assert(sizeof(CompassCalibration) <= MICROBIT_STORAGE_VALUE_SIZE, "calibration must fit a storage value");
+    CompassCalibration calibration = s_ubit.compass.getCalibration();
+    s_ubit.storage.put(COMPASS_CALIBRATION_KEY, (uint8_t*)&calibration, sizeof(calibration));
+}
+
+//----------------------------------------------------------------------------
+// Calibration draws on the display itself, so the display worker is held
+// off meanwhile: waiting ops are dropped, the running one is stopped, and
+// what was showing comes back afterwards. Display commands that arrive
+// meanwhile wait in the queue as usual.
+int calibrateCompass() {
+    // Before stopping anything, which clears the display.
+    s_heldBrightness = s_ubit.display.getBrightness();
+    s_heldImage = s_ubit.display.image.clone();
+    s_displayQueue.clearPending();
+    stopDisplayOp();
+    s_displayHeld = true;
+    while (s_displayQueue.busy()) {
+        fiber_sleep(DISPLAY_POLL_MS);
+    }
+
+    int result = s_ubit.compass.calibrate();
+
+    s_ubit.display.setDisplayMode(DISPLAY_MODE_GREYSCALE);
+    s_ubit.display.setBrightness(s_heldBrightness);
+    s_ubit.display.print(s_heldImage);
+    s_displayHeld = false;
+    MicroBitEvent(KODU_ID_DISPLAY_QUEUE, KODU_EVT_QUEUED);
+    return result;
+}
+
+//----------------------------------------------------------------------------
+// Keeps s_heading current while the host wants it, so sampled state never
+// waits on the compass. Calibration, which needs the user to tilt the
+// device, only happens here, and only once per device: it's saved to flash.
+void orientationFiber() {
+    while (1) {
+        if (!s_headingSubscribed) {
+            s_headingValid = false;
+            fiber_wait_for_event(KODU_ID_ORIENTATION, KODU_EVT_QUEUED);
+            continue;
+        }
+        if (!s_ubit.compass.isCalibrated() && !loadCompassCalibration()) {
+            if (calibrateCompass() != MICROBIT_OK) {
+                s_headingSubscribed = false;
+                sysmsg("ERR_CALIBRATION");
+                continue;
+            }
+            saveCompassCalibration();
+        }
+        int heading = s_ubit.compass.heading();
+        if (heading >= 0) {
+            s_heading = heading;
+            s_headingValid = true;
+        }
+        fiber_sleep(s_sampledStatePeriodMs ? s_sampledStatePeriodMs : 1000 / SAMPLED_STATE_HZ);
+    }
+    release_fiber();
+}
+
+//----------------------------------------------------------------------------
+void onConfigCompass(Message& msg) {
+    CmdConfigCompass cmd;
+    uint8_t recalibrate = 0;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    msg.readU8Hex(recalibrate);
+    if (recalibrate) {
+        s_ubit.storage.remove(COMPASS_CALIBRATION_KEY);
+        s_ubit.compass.clearCalibration();
+        s_headingValid = false;
+    }
+    s_headingSubscribed = cmd.heading != 0;
+    s_sentStateValid = false;
+    // The fiber and its stack only exist once the heading is first wanted.
+    if (s_headingSubscribed && !s_orientationFiberStarted) {
+        s_orientationFiberStarted = true;
+        create_fiber(orientationFiber);
+    }
+    MicroBitEvent(KODU_ID_ORIENTATION, KODU_EVT_QUEUED);
+}
+
+//----------------------------------------------------------------------------
+// Runs in the ticker's interrupt, so it only converts and stores.
+void onCaptureTick() {
+    if (s_capture.add(s_capturePin->getAnalogValue())) {
+        s_captureTicker.detach();
+        MicroBitEvent(KODU_ID_CAPTURE, KODU_EVT_QUEUED);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Uploads each finished capture, behind every other kind of message. A new
+// CMD_CAPTURE_ANALOG abandons the upload of the old one.
+void captureFiber() {
+    while (1) {
+        if (!s_capture.done()) {
+            fiber_wait_for_event(KODU_ID_CAPTURE, KODU_EVT_QUEUED);
+            continue;
+        }
+        // The ticker has stopped, so the pin is free again.
+        s_capturePin = NULL;
+        uint8_t id = s_captureId;
+        uint16_t count = s_capture.count();
+        for (uint16_t first = 0; first < count && id == s_captureId; first += CAPTURE_BLOCK_SAMPLES) {
+            // Build each block only once the last has gone, so a capture never
+            // holds more than one large pool slab.
+            while (s_tx.pending(TX_PRIORITY_BULK)) {
+                fiber_sleep(TX_POLL_MS);
+            }
+            if (id != s_captureId) {
+                break;
+            }
+            uint8_t packed[(CAPTURE_BLOCK_SAMPLES * 10 + 7) / 8];
+            int length = s_capture.pack(first, CAPTURE_BLOCK_SAMPLES, packed);
+            Message msg(CAPTURE_BLOCK_LENGTH);
+            msg.writeChar(EVT_CAPTURE_BLOCK);
+            msg.writeU8Hex(id);
+            msg.writeU16Hex(first);
+            msg.writeU16Hex(count);
+            msg.writeU16Hex(s_capture.triggerIndex());
+            msg.writeBytes(packed, length);
+            sendMessageInTurn(msg, TX_PRIORITY_BULK);
+        }
+        if (id == s_captureId) {
+            s_capture.stop();
+        }
+    }
+    release_fiber();
+}
+
+//----------------------------------------------------------------------------
+void onCaptureAnalog(Message& msg) {
+    CmdCaptureAnalog cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    if (cmd.pin > 2) {
+        return errmsg("ERR_ARGUMENT:pin>2", msg);
+    }
+    stopCapture();
+    if (!cmd.count) {
+        return;
+    }
+    if (cmd.periodUs < CAPTURE_MIN_PERIOD_US) {
+        return errmsg("ERR_ARGUMENT:periodUs", msg);
+    }
+    if (!s_capture.configure(cmd.decimation, (ECaptureTrigger)cmd.trigger, cmd.level, cmd.preTrigger, cmd.count)) {
+        return errmsg("ERR_ARGUMENT:capture", msg);
+    }
+    // Switch the pin to analog input here, so the interrupt never has to.
+    MicroBitPin& capturePin = s_ubit.io.pin[cmd.pin];
+    capturePin.getAnalogValue();
+    s_capturePin = &capturePin;
+    // The fiber and its stack only exist once a capture is first wanted.
+    if (!s_captureFiberStarted) {
+        s_captureFiberStarted = true;
+        create_fiber(captureFiber);
+    }
+    s_captureTicker.attach_us(onCaptureTick, cmd.periodUs);
+}
+
+//----------------------------------------------------------------------------
+void onGetStats(Message& msg) {
+    uint8_t reset = 0;
+    msg.consume(CMD_GET_STATS);
+    msg.readU8Hex(reset);
 
+    MessagePoolStats pool;
+    MessagePool::getStats(pool);
+    SequencerStats tones;
+    s_sequencer.getStats(tones);
+    Message stats(80);
+    stats.writeChar(EVT_STATS);
+    stats.writeU32Hex(s_stats.txBytes);
+    stats.writeU16Hex(s_stats.txStalls);
+    stats.writeU16Hex(s_stats.parseErrors);
+    stats.writeU16Hex(s_stats.displayBusy);
+    stats.writeU16Hex(s_displayQueue.droppedCount());
+    stats.writeU16Hex(s_stats.tonesPreempted);
+    stats.writeU8Hex(pool.inUse);
+    stats.writeU8Hex(pool.highWaterMark);
+    stats.writeU16Hex(pool.exhaustedCount);
+    stats.writeU32Hex(tones.noteCount);
+    stats.writeU16Hex(tones.maxLateMs);
+    if (!sendMessage(stats, TX_PRIORITY_REPLY)) {
+        return;
+    }
+
+    if (reset) {
+        s_stats.txBytes = 0;
+        s_stats.txStalls = 0;
+        s_stats.parseErrors = 0;
+        s_stats.displayBusy = 0;
+        s_stats.tonesPreempted = 0;
+        s_displayQueue.resetDroppedCount();
+        s_sequencer.resetStats();
+        MessagePool::resetStats();
+    }
+    // The per-command pages follow as the TX fiber frees reply slots.
+    s_statsNextOpcode = 0;
+    s_statsReset = reset;
+    sendStatsPages();
+}
+
+//----------------------------------------------------------------------------
+// Queues EVT_STATS_COMMANDS pages while there is room, never waiting. Each
+// page's counts are reset as it is queued, when asked to, so a command
+// dispatched meanwhile is reported by the next CMD_GET_STATS instead.
+void sendStatsPages() {
+    while (s_statsNextOpcode < COMMAND_COUNT && !s_tx.full(TX_PRIORITY_REPLY)) {
+        int next = s_statsNextOpcode;
+        uint8_t opcodes[STATS_OPCODES_PER_EVENT];
+        uint8_t count = 0;
+        for (; next < COMMAND_COUNT && count < STATS_OPCODES_PER_EVENT; ++next) {
+            if (s_stats.dispatched[next]) {
+                opcodes[count++] = next;
+            }
+        }
+        Message page(110);
+        page.writeChar(EVT_STATS_COMMANDS);
+        page.writeU8Hex(count);
+        for (int i = 0; i < count; ++i) {
+            page.writeChar('A' + opcodes[i]);
+            page.writeU16Hex(s_stats.dispatched[opcodes[i]]);
+            page.writeU16Hex(s_stats.maxDispatchUs[opcodes[i]]);
+            if (s_statsReset) {
+                s_stats.dispatched[opcodes[i]] = 0;
+                s_stats.maxDispatchUs[opcodes[i]] = 0;
+            }
+        }
+        // Don't follow a full event with an empty one.
+        while (next < COMMAND_COUNT && !s_stats.dispatched[next]) {
+            ++next;
+        }
+        s_statsNextOpcode = next;
+        sendMessage(page, TX_PRIORITY_REPLY);
+    }
+}
+
+//----------------------------------------------------------------------------
+EDispatchResult dispatchMessage(Message& msg);
+
+//----------------------------------------------------------------------------
+// Display commands are queued as a CMD_UPLOAD_COMMIT placeholder naming the
+// upload, which the display worker runs from the upload buffer. The buffer
+// can't take another upload while that's running.
+bool queueUploadedDisplayOp() {
+    Message placeholder(8);
+    placeholder.writeChar(CMD_UPLOAD_COMMIT);
+    placeholder.writeU8Hex(s_uploadId);
+    s_uploadStarted = queueDisplayOp(placeholder);
+    return s_uploadStarted;
+}
+
+//----------------------------------------------------------------------------
+void onUploadBegin(Message& msg) {
+    CmdUploadBegin cmd;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    if (s_uploadRunning || s_uploadDispatching) {
+        return errmsg("ERR_UPLOAD:busy", msg);
+    }
+    if (cmd.length == 0 || cmd.length > UPLOAD_MAX_LENGTH) {
+        return errmsg("ERR_ARGUMENT:length", msg);
+    }
+    s_uploadLength = cmd.length;
+    s_uploadReceived = 0;
+    ++s_uploadId;
+    s_uploadStarted = false;
+    s_uploadDone = false;
+    s_uploadChunkMs = system_timer_current_time();
+    s_uploadState = UPLOAD_RECEIVING;
+}
+
+//----------------------------------------------------------------------------
+// Chunks must arrive in order. A resent chunk only adds whatever part of it
+// is new, so resending is always safe.
+void onUploadChunk(Message& msg) {
+    CmdUploadChunk cmd;
+    Message data;
+    if (!readCommand(msg, cmd)) {
+        return;
+    }
+    uint16_t offset = cmd.offset;
+    if (!msg.readMessage(data)) {
+        return parseError(msg);
+    }
+    if (s_uploadState != UPLOAD_RECEIVING) {
+        return errmsg("ERR_UPLOAD:state", msg);
+    }
+    if (offset > s_uploadReceived) {
+        return errmsg("ERR_UPLOAD:offset", msg);
+    }
+    if (offset + data.length() > s_uploadLength) {
+        return errmsg("ERR_UPLOAD:length", msg);
+    }
+    int skip = s_uploadReceived - offset;
+    if (data.length() > skip) {
+        memcpy(s_uploadBuffer + s_uploadReceived, data.charBuffer() + skip, data.length() - skip);
+        s_uploadReceived = offset + data.length();
+    }
+    s_uploadChunkMs = system_timer_current_time();
+    // Image lists start playing with their first chunk.
+    if (!s_uploadStarted && s_uploadReceived > 0 && isImageListCommand(s_uploadBuffer[0])) {
+        queueUploadedDisplayOp();
+    }
+}
+
+//----------------------------------------------------------------------------
+void onUploadCommit(Message& msg) {
+    if (s_uploadState != UPLOAD_RECEIVING) {
+        return errmsg("ERR_UPLOAD:state", msg);
+    }
+    if (s_uploadReceived != s_uploadLength) {
+        return errmsg("ERR_UPLOAD:length", msg);
+    }
+    if (s_uploadStarted) {
+        // Already playing, or even done; let it read to the end.
+        s_uploadState = s_uploadDone ? UPLOAD_IDLE : UPLOAD_COMMITTED;
+        return;
+    }
+    s_uploadState = UPLOAD_IDLE;
+    char opcode = s_uploadBuffer[0];
+    if (opcode == CMD_UPLOAD_BEGIN || opcode == CMD_UPLOAD_CHUNK || opcode == CMD_UPLOAD_COMMIT) {
+        Message upload(s_uploadBuffer, s_uploadReceived);
+        return errmsg("ERR_ARGUMENT:nested", upload);
+    }
+    if (isDisplayCommand(opcode)) {
+        s_uploadState = UPLOAD_COMMITTED;
+        if (!queueUploadedDisplayOp()) {
+            s_uploadState = UPLOAD_IDLE;
+        }
+        return;
+    }
+    Message upload(s_uploadBuffer, s_uploadReceived);
+    s_uploadDispatching = true;
+    dispatchMessage(upload);
+    s_uploadDispatching = false;
+}
+
+//----------------------------------------------------------------------------
+// Each command in the batch is dispatched as if it had arrived on its own,
+// so it reports its own errors.
+void onBatch(Message& msg) {
+    CmdBatch batch;
+    if (!readCommand(msg, batch)) {
+        return;
+    }
+    while (batch.count--) {
+        Message cmd;
+        if (!msg.readMessage(cmd)) {
+            return parseError(msg);
+        }
+        char inner = 0;
+        cmd.readChar(inner);
+        cmd.rewind();
+        if (inner == CMD_BATCH) {
+            errmsg("ERR_ARGUMENT:nested", cmd);
+        } else {
+            dispatchMessage(cmd);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+void sendAck(uint8_t seq) {
+    Message msg(10);
+    msg.writeChar(EVT_ACK);
+    msg.writeU8Hex(seq);
+    sendMessage(msg, TX_PRIORITY_REPLY);
+}
+
+//----------------------------------------------------------------------------
+void sendNack(uint8_t seq, ENackReason reason) {
+    Message msg(10);
+    msg.writeChar(EVT_NACK);
+    msg.writeU8Hex(seq);
+    msg.writeU8Hex(reason);
+    sendMessage(msg, TX_PRIORITY_REPLY);
+}
+
+//----------------------------------------------------------------------------
+// The host may resend a command whose ACK it didn't see. One already run is
+// only acknowledged again, so resends never repeat its effects. A command
+// that reports an error is NACKed instead and not remembered, so the host's
+// resend runs it again.
+void onReliable(Message& msg) {
+    CmdReliable reliable;
+    Message cmd;
+    int decoded;
+    // Without a seq there is nothing to NACK.
+    if (!decodeCommand(msg, reliable, &decoded) && decoded == 0) {
+        return parseError(msg);
+    }
+    uint8_t seq = reliable.seq;
+    if (decoded < CmdReliable::Fields::count || !msg.readMessage(cmd)) {
+        return sendNack(seq, NACK_PARSE);
+    }
+    if (crc16(cmd.byteBuffer(), cmd.length()) != reliable.crc) {
+        return sendNack(seq, NACK_CHECKSUM);
+    }
+    for (int i = 0; i < s_reliableCount; ++i) {
+        if (s_reliableSeqs[i] == seq) {
+            return sendAck(seq);
+        }
+    }
+    char inner = 0;
+    cmd.readChar(inner);
+    cmd.rewind();
+    if (inner == CMD_RELIABLE) {
+        return sendNack(seq, NACK_NESTED);
+    }
+    switch (dispatchMessage(cmd)) {
+        case DISPATCH_OK:
+            break;
+        case DISPATCH_PARSE_ERROR:
+            return sendNack(seq, NACK_PARSE);
+        case DISPATCH_BUSY:
+            return sendNack(seq, NACK_BUSY);
+        case DISPATCH_REFUSED:
+            return sendNack(seq, NACK_REFUSED);
+    }
+    s_reliableSeqs[s_reliableNext] = seq;
+    s_reliableNext = (s_reliableNext + 1) % RELIABLE_WINDOW;
+    if (s_reliableCount < RELIABLE_WINDOW) {
+        ++s_reliableCount;
+    }
+    sendAck(seq);
+}
+
+//----------------------------------------------------------------------------
+// Handlers by opcode, CMD_SCROLL_IMAGES ('A') first. Unused letters have no
+// handler.
+struct CommandHandler {
+    char opcode;
+    void (*handler)(Message& msg);
+};
+
+static constexpr CommandHandler s_commands[COMMAND_COUNT] = {
+    {CMD_SCROLL_IMAGES, onDisplayOp},
+    {CMD_PRINT_IMAGES, onDisplayOp},
+    {CMD_SCROLL_TEXT, onDisplayOp},
+    {CMD_PRINT_TEXT, onDisplayOp},
+    {CMD_CONFIG_INPUT_PIN, onConfigInputPin},
+    {CMD_SET_PIN_VALUE, onSetPinValue},
+    {CMD_SET_PIN_SERVO_VALUE, onSetPinServoValue},
+    {CMD_PLAY_TONES, onPlayTones},
+    {CMD_SET_PIXEL, onSetPixel},
+    {CMD_PRINT_DISPLAY_FRAMES, onDisplayOp},
+    {CMD_SET_PIN_PWM_OUT, onSetPinPwmOut},
+    {CMD_RUN_BENCHMARKS, onRunBenchmarks},
+    {CMD_CONFIG_DISPLAY_QUEUE, onConfigDisplayQueue},
+    {CMD_CONFIG_TELEMETRY, onConfigTelemetry},
+    {CMD_CONFIG_DELTA, onConfigDelta},
+    {CMD_PING, onPing},
+    {CMD_BATCH, onBatch},
+    {CMD_SHOW_ICON, onDisplayOp},
+    {CMD_START, onStart},
+    {CMD_PLAY_MELODY, onPlayMelody},
+    {CMD_CACHE_FRAMES, onCacheFrames},
+    {CMD_PLAY_CACHED_FRAMES, onDisplayOp},
+    {CMD_CONFIG_EVENTS, onConfigEvents},
+    {CMD_GET_STATS, onGetStats},
+    {CMD_CONFIG_ACCEL, onConfigAccel},
+    {CMD_CONFIG_COMPASS, onConfigCompass},
+};
+
+constexpr bool commandsInOrder(int i) {
+    return i == COMMAND_COUNT ||
+           ((!s_commands[i].opcode || s_commands[i].opcode == 'A' + i) && commandsInOrder(i + 1));
+}
+static_assert(commandsInOrder(0), "s_commands must be in opcode order");
+
+//----------------------------------------------------------------------------
+void runCommand(char cmd, Message& msg) {
+    if (cmd < 'A' || cmd > 'Z' || !s_commands[cmd - 'A'].handler) {
+        return errmsg("ERR_UNKNOWN", msg);
+    }
+    s_commands[cmd - 'A'].handler(msg);
+}
+
+//----------------------------------------------------------------------------
+// Commands dispatched from inside another (batched, reliable or uploaded)
+// report to their own caller only.
+EDispatchResult dispatchMessage(Message& msg) {
+    EDispatchResult outer = s_dispatchResult;
+    s_dispatchResult = DISPATCH_OK;
+    char cmd = 0;
+    msg.readChar(cmd);
+    msg.rewind();
+    uint64_t startUs = system_timer_current_time_us();
     switch (cmd) {
-        case CMD_PING:
-            return onPing();
-        case CMD_START:
-            return onStart();
-        case CMD_SCROLL_IMAGES:
-            return onScrollImages(msg);
-        case CMD_PRINT_IMAGES:
-            return onPrintImages(msg);
-        case CMD_SCROLL_TEXT:
-            return onScrollText(msg);
-        case CMD_PRINT_TEXT:
-            return onPrintText(msg);
-        case CMD_CONFIG_INPUT_PIN:
-            return onConfigInputPin(msg);
-        case CMD_SET_PIN_VALUE:
-            return onSetPinValue(msg);
-        case CMD_SET_PIN_SERVO_VALUE:
-            return onSetPinServoValue(msg);
-        case CMD_PLAY_TONES:
-            return onPlayTones(msg);
-        case CMD_SET_PIXEL:
-            return onSetPixel(msg);
-        case CMD_PRINT_DISPLAY_FRAMES:
-            return onPrintDisplayFrames(msg);
-        case CMD_SET_PIN_PWM_OUT:
-            return onSetPinPwmOut(msg);
+        case CMD_RELIABLE:
+            onReliable(msg);
+            break;
+        case CMD_UPLOAD_BEGIN:
+            onUploadBegin(msg);
+            break;
+        case CMD_UPLOAD_CHUNK:
+            onUploadChunk(msg);
+            break;
+        case CMD_UPLOAD_COMMIT:
+            onUploadCommit(msg);
+            break;
+        case CMD_CAPTURE_ANALOG:
+            onCaptureAnalog(msg);
+            break;
         default:
-            return errmsg("ERR_UNKNOWN", msg);
+            runCommand(cmd, msg);
+            break;
     }
+    if (cmd >= 'A' && cmd <= 'Z') {
+        int opcode = cmd - 'A';
+        uint64_t elapsedUs = system_timer_current_time_us() - startUs;
+        s_stats.dispatched[opcode]++;
+        if (elapsedUs > s_stats.maxDispatchUs[opcode]) {
+            s_stats.maxDispatchUs[opcode] = elapsedUs > 0xFFFF ? 0xFFFF : (uint16_t)elapsedUs;
+        }
+    }
+    EDispatchResult result = s_dispatchResult;
+    s_dispatchResult = outer;
+    return result;
+}
+
+//----------------------------------------------------------------------------
+char messageDelimiter() {
+    return Message::defaultFormat() == WIRE_FORMAT_BINARY ? FRAME_DELIMITER : '\n';
+}
+
+//----------------------------------------------------------------------------
+void armReceive() {
+    char delimiter = messageDelimiter();
+    s_ubit.serial.eventOn(ManagedString(&delimiter, 1), ASYNC);
 }
 
 //----------------------------------------------------------------------------
 void onReceiveMessage(MicroBitEvent) {
-    s_sendStateIterations = SAMPLED_STATE_ITERATIONS;
-    ManagedString msg = s_ubit.serial.readUntil("\n", SYNC_SLEEP);
-    dispatchMessage(msg.toCharArray(), msg.length());
-    s_ubit.serial.eventOn("\n", ASYNC);
+    s_sampledStateDeadlineMs = system_timer_current_time() + s_sampledStateWindowMs;
+    // Read the line straight out of the serial buffer into a pooled message.
+    // Commands that outlive dispatch (display, tones) take over that buffer
+    // instead of copying it.
+    char delimiter = messageDelimiter();
+    Message msg(SERIAL_RX_BUFFER_SIZE);
+    int capacity;
+    uint8_t* dst = msg.receiveBuffer(capacity);
+    int length = 0;
+    bool overflow = false;
+    int c;
+    while ((c = s_ubit.serial.read(SYNC_SLEEP)) >= 0 && c != delimiter) {
+        // A NUL is only there to end a binary frame for a device that may
+        // still be in binary; see below.
+        if (c == FRAME_DELIMITER) {
+            continue;
+        }
+        if (length < capacity) {
+            dst[length++] = (uint8_t)c;
+        } else {
+            overflow = true;
+        }
+    }
+    if (!dst) {
+        rxerrmsg("ERR_NO_MEMORY");
+    } else if (overflow) {
+        rxerrmsg("ERR_OVERFLOW");
+    } else if (!msg.endReceive(length)) {
+        // Sent in binary, then back to ASCII: the host may have restarted
+        // and be talking ASCII, which a binary device only sees as bad
+        // frames. A binary host renegotiates after ERR_FRAME.
+        rxerrmsg("ERR_FRAME");
+        Message::setDefaultFormat(WIRE_FORMAT_ASCII);
+    } else {
+        dispatchMessage(msg);
+    }
+    // Re-arm with the delimiter of the (possibly renegotiated) format.
+    armReceive();
 }
 
 //----------------------------------------------------------------------------
@@ -538,79 +1881,277 @@ void onButton(MicroBitEvent e) {
         s_buttonState[0] = e.value;
     if (e.source == 2)
         s_buttonState[1] = e.value;
-    Message msg(20);
-    msg.writeChar(EVT_BUTTON_STATE);
+    Message msg(30);
+    writeEvent(msg, EVT_BUTTON_STATE, e.timestamp);
     msg.writeU8Hex(e.source);
     msg.writeU8Hex(e.value);
-    s_ubit.serial.send(msg.byteBuffer(), msg.finalize());
+    sendMessage(msg, TX_PRIORITY_INPUT);
 }
 
 //----------------------------------------------------------------------------
 void onAccelGesture(MicroBitEvent e) {
-    Message msg(20);
-    msg.writeChar(EVT_ACCEL_GESTURE);
+    Message msg(30);
+    writeEvent(msg, EVT_ACCEL_GESTURE, e.timestamp);
     msg.writeU8Hex(e.value);
-    s_ubit.serial.send(msg.byteBuffer(), msg.finalize());
+    sendMessage(msg, TX_PRIORITY_INPUT);
 }
 
 //----------------------------------------------------------------------------
-void sendSampledState() {
-    Message msg(50);
-    msg.writeChar(EVT_SAMPLED_STATE);
+// The DAL timestamps the edge in its pin interrupt, so the event header's
+// time is when the pin changed, not when this ran.
+void onPinEdge(MicroBitEvent e) {
+    int pin = e.source - MICROBIT_ID_IO_P0;
+    if (pin < 0 || pin > 2) {
+        return;
+    }
+    uint8_t edge;
+    if (e.value == MICROBIT_PIN_EVT_RISE) {
+        edge = PIN_EDGE_RISE;
+    } else if (e.value == MICROBIT_PIN_EVT_FALL) {
+        edge = PIN_EDGE_FALL;
+    } else {
+        return;
+    }
+    if (!(s_pinEdges[pin] & edge)) {
+        return;
+    }
+    Message msg(30);
+    writeEvent(msg, EVT_PIN_EDGE, e.timestamp);
+    msg.writeU8Hex(pin);
+    msg.writeU8Hex(edge == PIN_EDGE_RISE ? 1 : 0);
+    sendMessage(msg, TX_PRIORITY_INPUT);
+}
+
+//----------------------------------------------------------------------------
+// Runs for every sample the accelerometer takes, so the filter sees them all
+// rather than one per sampled state tick.
+void onAccelData(MicroBitEvent) {
+    if (s_accelFilter.filter() != ACCEL_FILTER_NONE) {
+        s_accelFilter.add(s_ubit.accelerometer.getX(), s_ubit.accelerometer.getY(),
+                          s_ubit.accelerometer.getZ());
+    }
+}
+
+//----------------------------------------------------------------------------
+void writeSectionTag(Message& msg, char tag) {
+    if (msg.format() == WIRE_FORMAT_ASCII) {
+        msg.writeChar(tag);
+    }
+}
+
+//----------------------------------------------------------------------------
+void sampleState(SampledState& state) {
+    memset(&state, 0, sizeof(state));
+    state.buttons[0] = s_buttonState[0];
+    state.buttons[1] = s_buttonState[1];
+    if (s_accelFilter.filter() == ACCEL_FILTER_NONE || !s_accelFilter.get(state.acc)) {
+        state.acc[0] = s_ubit.accelerometer.getX();
+        state.acc[1] = s_ubit.accelerometer.getY();
+        state.acc[2] = s_ubit.accelerometer.getZ();
+    }
+    if (s_sendTilt) {
+        state.tilt[0] = AccelFilter::pitch(state.acc);
+        state.tilt[1] = AccelFilter::roll(state.acc);
+    }
+    if (s_headingSubscribed && s_headingValid) {
+        state.hasHeading = true;
+        state.heading = s_heading;
+    }
+    for (int i = 0; i < 3; ++i) {
+        MicroBitPin& pin = s_ubit.io.pin[i];
+        // The DAL doesn't count a pin raising edge events as an input.
+        if (pin.isInput() || s_pinEdges[i]) {
+            if (&pin == s_capturePin) {
+                state.pinMode[i] = 'a';
+                state.pinValue[i] = s_capture.latest();
+            } else if (pin.isAnalog()) {
+                // The nRF51 has one ADC. A conversion here while the capture
+                // interrupt may start its own would corrupt both, so the
+                // other analog pins repeat their last value until it ends.
+                if (!s_capturePin) {
+                    s_analogHeld[i] = pin.getAnalogValue();
+                }
+                state.pinMode[i] = 'a';
+                state.pinValue[i] = s_analogHeld[i];
+            } else {
+                state.pinMode[i] = 'd';
+                state.pinValue[i] = pin.getDigitalValue();
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+void writeSampledState(Message& msg, const SampledState& state, uint64_t timeUs) {
+    writeEvent(msg, EVT_SAMPLED_STATE, timeUs);
+    if (msg.format() == WIRE_FORMAT_BINARY) {
+        // Binary frames flag the sections up front instead of tagging each.
+        msg.writeU8Hex(SECTION_BUTTONS | SECTION_ACCEL | SECTION_PINS | (s_sendTilt ? SECTION_TILT : 0) |
+                       (state.hasHeading ? SECTION_COMPASS : 0));
+    }
     // Write button states
-    msg.writeChar('b');
-    msg.writeU8Hex(s_buttonState[0]);
-    msg.writeU8Hex(s_buttonState[1]);
+    writeSectionTag(msg, 'b');
+    msg.writeU8Hex(state.buttons[0]);
+    msg.writeU8Hex(state.buttons[1]);
     // Write accelerometer
-    msg.writeChar('a');
-    msg.writeU16Hex(s_ubit.accelerometer.getX());
-    msg.writeU16Hex(s_ubit.accelerometer.getY());
-    msg.writeU16Hex(s_ubit.accelerometer.getZ());
-    // msg.writeU16Hex(s_ubit.accelerometer.getPitch());
-    // msg.writeU16Hex(s_ubit.accelerometer.getRoll());
-    // Write compass heading - disabled because of the calibration step that
-    // happens every time Kodu enters play mode.
-    /*
-    msg.writeChar('c');
-    int compassHeading = max(0, s_ubit.compass.heading());
-    msg.writeU16Hex(compassHeading);
-    */
+    writeSectionTag(msg, 'a');
+    msg.writeU16Hex(state.acc[0]);
+    msg.writeU16Hex(state.acc[1]);
+    msg.writeU16Hex(state.acc[2]);
+    if (s_sendTilt) {
+        msg.writeU16Hex(state.tilt[0]);
+        msg.writeU16Hex(state.tilt[1]);
+    }
+    // Write compass heading, in degrees, when subscribed and calibrated.
+    if (state.hasHeading) {
+        writeSectionTag(msg, 'c');
+        msg.writeU16Hex(state.heading);
+    }
     // Write input pins
     uint8_t pinCount = 0;
     for (int i = 0; i < 3; ++i) {
-        if (s_ubit.io.pin[i].isInput()) {
+        if (state.pinMode[i]) {
             ++pinCount;
         }
     }
-    msg.writeChar('p');
+    writeSectionTag(msg, 'p');
     msg.writeU8Hex(pinCount);
     for (int i = 0; i < 3; ++i) {
-        MicroBitPin& pin = s_ubit.io.pin[i];
-        if (pin.isInput()) {
-            // pin id
+        if (state.pinMode[i]) {
+            // pin id, analog or digital, value
             msg.writeU8Hex(i);
-            if (pin.isAnalog()) {
-                // analog value
-                msg.writeChar('a');
-                msg.writeU16Hex(pin.getAnalogValue());
-            } else {
-                // digital value
-                msg.writeChar('d');
-                msg.writeU16Hex(pin.getDigitalValue());
+            msg.writeChar(state.pinMode[i]);
+            msg.writeU16Hex(state.pinValue[i]);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Writes the fields of state that differ from base. Returns false, having
+// written nothing, if none do.
+bool writeSampledStateDelta(Message& msg, const SampledState& state, const SampledState& base, uint64_t timeUs) {
+    uint8_t fields = 0;
+    for (int i = 0; i < 2; ++i) {
+        if (state.buttons[i] != base.buttons[i]) {
+            fields |= FIELD_BUTTON_A << i;
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (abs(state.acc[i] - base.acc[i]) > s_accDeadband[i]) {
+            fields |= FIELD_ACC_X << i;
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (state.pinMode[i] != base.pinMode[i] || state.pinValue[i] != base.pinValue[i]) {
+            fields |= FIELD_PIN_0 << i;
+        }
+    }
+    if (!fields) {
+        return false;
+    }
+    writeEvent(msg, EVT_SAMPLED_STATE_DELTA, timeUs);
+    msg.writeU8Hex(fields);
+    for (int i = 0; i < 2; ++i) {
+        if (fields & (FIELD_BUTTON_A << i)) {
+            msg.writeU8Hex(state.buttons[i]);
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (fields & (FIELD_ACC_X << i)) {
+            msg.writeU16Hex(state.acc[i]);
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (fields & (FIELD_PIN_0 << i)) {
+            msg.writeChar(state.pinMode[i] ? state.pinMode[i] : '-');
+            msg.writeU16Hex(state.pinValue[i]);
+        }
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// Returns false if the link is behind: the last frame was still waiting to
+// be sent.
+bool sendSampledState() {
+    SampledState state;
+    sampleState(state);
+    uint64_t sampledUs = system_timer_current_time_us();
+
+    unsigned long now = system_timer_current_time();
+    bool keepalive = now - s_sentStateMs >= SAMPLED_STATE_KEEPALIVE_MS;
+    if (s_sampledStatePolicy == TELEMETRY_ON_CHANGE && s_sentStateValid &&
+        !memcmp(&state, &s_sentState, sizeof(state)) && !keepalive) {
+        return true;
+    }
+
+    // In delta mode, changes are sent against the state the host last saw,
+    // with a full keyframe every so often so it can resync. A frame still
+    // waiting is replaced by this one, and the host never sees it, so this
+    // one must be a keyframe.
+    bool behind = s_tx.pending(TX_PRIORITY_TELEMETRY);
+    bool keyframe = !s_deltaKeyframeTicks || !s_sentStateValid || behind ||
+                    s_ticksSinceKeyframe + 1 >= s_deltaKeyframeTicks;
+    Message msg(SAMPLED_STATE_MAX_LENGTH);
+    if (keyframe) {
+        writeSampledState(msg, state, sampledUs);
+    } else if (!writeSampledStateDelta(msg, state, s_sentState, sampledUs)) {
+        if (!keepalive) {
+            ++s_ticksSinceKeyframe;
+            return true;
+        }
+        writeSampledState(msg, state, sampledUs);
+        keyframe = true;
+    }
+    if (!sendMessage(msg, TX_PRIORITY_TELEMETRY)) {
+        return false;
+    }
+    s_ticksSinceKeyframe = keyframe ? 0 : s_ticksSinceKeyframe + 1;
+    // Fields inside the deadband weren't sent, so keep the old values as
+    // the baseline the host holds.
+    if (keyframe) {
+        s_sentState = state;
+    } else {
+        SampledState sent = state;
+        for (int i = 0; i < 3; ++i) {
+            if (abs(state.acc[i] - s_sentState.acc[i]) <= s_accDeadband[i]) {
+                sent.acc[i] = s_sentState.acc[i];
             }
         }
+        s_sentState = sent;
     }
-    s_ubit.serial.send(msg.byteBuffer(), msg.finalize());
+    s_sentStateValid = true;
+    s_sentStateMs = now;
+    return !behind;
+}
+
+//----------------------------------------------------------------------------
+bool sampledStateActive() {
+    if (!s_sampledStatePeriodMs) {
+        return false;
+    }
+    if (s_sampledStatePolicy == TELEMETRY_WINDOWED) {
+        return (long)(s_sampledStateDeadlineMs - system_timer_current_time()) > 0;
+    }
+    return true;
 }
 
 //----------------------------------------------------------------------------
 void sendSampledStateFiber() {
     while (1) {
-        if (s_sendStateIterations > 0) {
-            s_sendStateIterations -= 1;
-            sendSampledState();
+        if (sampledStateActive()) {
+            // Back off while the TX buffer can't take a whole frame, and
+            // recover one step per frame that goes out.
+            if (sendSampledState()) {
+                if (s_sampledStateBackoff > 0) {
+                    --s_sampledStateBackoff;
+                }
+            } else if (s_sampledStateBackoff < SAMPLED_STATE_MAX_BACKOFF) {
+                ++s_sampledStateBackoff;
+            }
         }
-        fiber_sleep(1000 / SAMPLED_STATE_HZ);
+        int periodMs = s_sampledStatePeriodMs ? s_sampledStatePeriodMs : 1000 / SAMPLED_STATE_HZ;
+        fiber_sleep(periodMs << s_sampledStateBackoff);
     }
     release_fiber();
 }
@@ -638,19 +2179,27 @@ int main() {
 
     // Configure serial comms.
     s_ubit.serial.baud(115200);
-    s_ubit.serial.setRxBufferSize(128);
+    s_ubit.serial.setRxBufferSize(SERIAL_RX_BUFFER_SIZE);
     s_ubit.serial.setTxBufferSize(128);
-    s_ubit.serial.eventOn("\n", ASYNC);
+    armReceive();
 
     // Set up event handlers.
     s_ubit.messageBus.listen(MICROBIT_ID_BUTTON_A, MICROBIT_EVT_ANY, onButton);
     s_ubit.messageBus.listen(MICROBIT_ID_BUTTON_B, MICROBIT_EVT_ANY, onButton);
     s_ubit.messageBus.listen(MICROBIT_ID_GESTURE, MICROBIT_EVT_ANY, onAccelGesture);
+    s_ubit.messageBus.listen(MICROBIT_ID_IO_P0, MICROBIT_EVT_ANY, onPinEdge);
+    s_ubit.messageBus.listen(MICROBIT_ID_IO_P1, MICROBIT_EVT_ANY, onPinEdge);
+    s_ubit.messageBus.listen(MICROBIT_ID_IO_P2, MICROBIT_EVT_ANY, onPinEdge);
+    s_ubit.messageBus.listen(MICROBIT_ID_ACCELEROMETER, MICROBIT_ACCELEROMETER_EVT_DATA_UPDATE, onAccelData,
+                             MESSAGE_BUS_LISTENER_IMMEDIATE);
     s_ubit.messageBus.listen(MICROBIT_ID_SERIAL, MICROBIT_SERIAL_EVT_DELIM_MATCH,
                              onReceiveMessage);
 
-    // Start the "sampled state" send loop.
+    // Start the sender, the display worker and the "sampled state" send loop.
+    create_fiber(txFiber);
+    create_fiber(displayWorkerFiber);
     create_fiber(sendSampledStateFiber);
+    create_fiber(sequencerFiber);
 
     // Main fiber can exit now.
     release_fiber();
@@ -0,0 +1,149 @@
+// Generated by CodeGenUtil from Melodies.cs. Do not edit.
+
+#ifndef MELODIES_H
+#define MELODIES_H
+
+#include <stdint.h>
+
+enum EMelody {
+    MELODY_DADADADUM = 0,
+    MELODY_ENTERTAINER = 1,
+    MELODY_PRELUDE = 2,
+    MELODY_ODE = 3,
+    MELODY_NYAN = 4,
+    MELODY_RINGTONE = 5,
+    MELODY_FUNK = 6,
+    MELODY_BLUES = 7,
+    MELODY_BIRTHDAY = 8,
+    MELODY_WEDDING = 9,
+    MELODY_FUNERAL = 10,
+    MELODY_PUNCHLINE = 11,
+    MELODY_BADDY = 12,
+    MELODY_CHASE = 13,
+    MELODY_BA_DING = 14,
+    MELODY_WAWAWAWAA = 15,
+    MELODY_JUMP_UP = 16,
+    MELODY_JUMP_DOWN = 17,
+    MELODY_POWER_UP = 18,
+    MELODY_POWER_DOWN = 19,
+    MELODY_COUNT = 20,
+};
+
+// A frequency of 0 is a rest.
+struct MelodyNote {
+    uint16_t frequency;
+    uint16_t durationMs;
+};
+
+static constexpr MelodyNote s_melodyNotes[] = {
+    // Dadadadum
+    {0, 250}, {392, 250}, {392, 250}, {392, 250}, {311, 1000}, {0, 250},
+    {349, 250}, {349, 250}, {349, 250}, {294, 1000},
+    // Entertainer
+    {294, 125}, {311, 125}, {330, 125}, {523, 250}, {330, 125}, {523, 250},
+    {330, 125}, {523, 375}, {523, 125}, {587, 125}, {622, 125}, {659, 125},
+    {523, 125}, {587, 125}, {659, 250}, {494, 125}, {587, 250}, {523, 500},
+    // Prelude
+    {262, 125}, {330, 125}, {392, 125}, {523, 125}, {659, 125}, {392, 125},
+    {523, 125}, {659, 125}, {262, 125}, {330, 125}, {392, 125}, {523, 125},
+    {659, 125}, {392, 125}, {523, 125}, {659, 125}, {262, 125}, {294, 125},
+    {392, 125}, {587, 125}, {698, 125}, {392, 125}, {587, 125}, {698, 125},
+    {262, 125}, {294, 125}, {392, 125}, {587, 125}, {698, 125}, {392, 125},
+    {587, 125}, {698, 125}, {247, 125}, {294, 125}, {392, 125}, {587, 125},
+    {698, 125}, {392, 125}, {587, 125}, {698, 125}, {247, 125}, {294, 125},
+    {392, 125}, {587, 125}, {698, 125}, {392, 125}, {587, 125}, {698, 125},
+    {262, 125}, {330, 125}, {392, 125}, {523, 125}, {659, 125}, {392, 125},
+    {523, 125}, {659, 125}, {262, 125}, {330, 125}, {392, 125}, {523, 125},
+    {659, 125}, {392, 125}, {523, 125}, {659, 125},
+    // Ode
+    {330, 500}, {330, 500}, {349, 500}, {392, 500}, {392, 500}, {349, 500},
+    {330, 500}, {294, 500}, {262, 500}, {262, 500}, {294, 500}, {330, 500},
+    {330, 750}, {294, 250}, {294, 1000}, {330, 500}, {330, 500}, {349, 500},
+    {392, 500}, {392, 500}, {349, 500}, {330, 500}, {294, 500}, {262, 500},
+    {262, 500}, {294, 500}, {330, 500}, {294, 750}, {262, 250}, {262, 1000},
+    // Nyan
+    {740, 250}, {831, 250}, {555, 125}, {622, 250}, {494, 125}, {587, 125},
+    {555, 125}, {494, 250}, {494, 250}, {555, 250}, {587, 250}, {587, 125},
+    {555, 125}, {494, 125}, {555, 125}, {622, 125}, {740, 125}, {831, 125},
+    {622, 125}, {740, 125}, {555, 125}, {587, 125}, {494, 125}, {555, 125},
+    {494, 125}, {622, 250}, {740, 250}, {831, 125}, {622, 125}, {740, 125},
+    {555, 125}, {622, 125}, {494, 125}, {587, 125}, {622, 125}, {587, 125},
+    {555, 125}, {494, 125}, {555, 125}, {587, 250}, {494, 125}, {555, 125},
+    {622, 125}, {740, 125}, {555, 125}, {587, 125}, {555, 125}, {494, 125},
+    {555, 250}, {494, 250}, {555, 250}, {494, 250}, {370, 125}, {415, 125},
+    {494, 250}, {370, 125}, {415, 125}, {494, 125}, {555, 125}, {622, 125},
+    {494, 125}, {659, 125}, {622, 125}, {659, 125}, {740, 125}, {494, 250},
+    {494, 250}, {370, 125}, {415, 125}, {494, 125}, {370, 125}, {659, 125},
+    {622, 125}, {555, 125}, {494, 125}, {370, 125}, {311, 125}, {330, 125},
+    {370, 125}, {494, 250}, {370, 125}, {415, 125}, {494, 250}, {370, 125},
+    {415, 125}, {494, 125}, {494, 125}, {555, 125}, {622, 125}, {494, 125},
+    {370, 125}, {415, 125}, {370, 125}, {494, 250}, {494, 125}, {466, 125},
+    {494, 125}, {370, 125}, {415, 125}, {494, 125}, {659, 125}, {622, 125},
+    {659, 125}, {740, 125}, {494, 250}, {555, 250},
+    // Ringtone
+    {262, 125}, {294, 125}, {330, 250}, {392, 250}, {294, 125}, {330, 125},
+    {349, 250}, {440, 250}, {330, 125}, {349, 125}, {392, 250}, {494, 250},
+    {523, 500},
+    // Funk
+    {66, 250}, {66, 250}, {78, 250}, {66, 125}, {87, 250}, {66, 125},
+    {87, 250}, {92, 250}, {98, 250}, {66, 250}, {66, 250}, {98, 250},
+    {66, 125}, {92, 250}, {66, 125}, {92, 250}, {87, 250}, {78, 250},
+    // Blues
+    {66, 250}, {82, 250}, {98, 250}, {110, 250}, {116, 250}, {110, 250},
+    {98, 250}, {82, 250}, {66, 250}, {82, 250}, {98, 250}, {110, 250},
+    {116, 250}, {110, 250}, {98, 250}, {82, 250}, {87, 250}, {110, 250},
+    {131, 250}, {147, 250}, {156, 250}, {147, 250}, {131, 250}, {110, 250},
+    {66, 250}, {82, 250}, {98, 250}, {110, 250}, {116, 250}, {110, 250},
+    {98, 250}, {82, 250}, {98, 250}, {124, 250}, {147, 250}, {175, 250},
+    {87, 250}, {110, 250}, {131, 250}, {156, 250}, {66, 250}, {82, 250},
+    {98, 250}, {82, 250}, {98, 250}, {87, 250}, {82, 250}, {74, 250},
+    // Birthday
+    {262, 375}, {262, 125}, {294, 500}, {262, 500}, {349, 500}, {330, 1000},
+    {262, 375}, {262, 125}, {294, 500}, {262, 500}, {392, 500}, {349, 1000},
+    {262, 375}, {262, 125}, {523, 500}, {440, 500}, {349, 500}, {330, 500},
+    {294, 500}, {466, 375}, {466, 125}, {440, 500}, {349, 500}, {392, 500},
+    {349, 1000},
+    // Wedding
+    {262, 500}, {349, 375}, {349, 125}, {349, 1000}, {262, 500}, {392, 375},
+    {330, 125}, {349, 1000}, {262, 500}, {349, 375}, {440, 125}, {523, 500},
+    {440, 375}, {349, 125}, {349, 500}, {330, 375}, {349, 125}, {392, 1000},
+    // Funeral
+    {131, 500}, {131, 375}, {131, 125}, {131, 500}, {156, 375}, {147, 125},
+    {147, 375}, {131, 125}, {131, 375}, {124, 125}, {131, 500},
+    // Punchline
+    {262, 375}, {196, 125}, {185, 125}, {196, 125}, {208, 375}, {196, 375},
+    {0, 375}, {247, 375}, {262, 375},
+    // Baddy
+    {131, 375}, {0, 375}, {147, 250}, {156, 250}, {0, 250}, {131, 250},
+    {0, 250}, {185, 1000},
+    // Chase
+    {440, 125}, {494, 125}, {523, 125}, {494, 125}, {440, 250}, {0, 250},
+    {440, 125}, {494, 125}, {523, 125}, {494, 125}, {440, 250}, {0, 250},
+    {440, 250}, {659, 250}, {622, 250}, {659, 250}, {698, 250}, {659, 250},
+    {622, 250}, {659, 250}, {494, 125}, {523, 125}, {587, 125}, {523, 125},
+    {494, 250}, {0, 250}, {494, 125}, {523, 125}, {587, 125}, {523, 125},
+    {494, 250}, {0, 250}, {494, 250}, {659, 250}, {622, 250}, {659, 250},
+    {698, 250}, {659, 250}, {622, 250}, {659, 250},
+    // BaDing
+    {988, 125}, {1320, 375},
+    // Wawawawaa
+    {165, 375}, {0, 125}, {156, 375}, {0, 125}, {147, 500}, {0, 125},
+    {139, 1000},
+    // JumpUp
+    {523, 125}, {587, 125}, {659, 125}, {698, 125}, {784, 125},
+    // JumpDown
+    {784, 125}, {698, 125}, {659, 125}, {587, 125}, {523, 125},
+    // PowerUp
+    {392, 125}, {523, 125}, {659, 125}, {784, 250}, {659, 125}, {784, 375},
+    // PowerDown
+    {784, 125}, {622, 125}, {523, 125}, {392, 250}, {494, 125}, {523, 375},
+};
+
+// Melody i is s_melodyNotes[s_melodyStarts[i]] up to s_melodyStarts[i + 1].
+static constexpr uint16_t s_melodyStarts[MELODY_COUNT + 1] = {
+    0, 10, 28, 92, 122, 228, 241, 259, 307, 332,
+    350, 361, 370, 378, 418, 420, 427, 432, 437, 443,
+    449,
+};
+
+#endif  // MELODIES_H
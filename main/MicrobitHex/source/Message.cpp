@@ -1,35 +1,68 @@
 #include "MicroBit.h"
 
 #include "Message.h"
+#include "Framing.h"
+#include "MessagePool.h"
 
 #include <stdlib.h>
 #include <string.h>
 
 //============================================================================
 
-static const char ToAscii[] = {'0', '1', '2', '3', '4', '5', '6', '7',
-                               '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+// Starts an Image field holding a greyscale image. It can't be the first row
+// of a black and white one, which is a base-36 digit or a byte below 32.
+#define GREYSCALE_IMAGE_MARKER '*'
+
+// Marks a character that isn't a digit in FromAsciiDigits.
+#define NOT_A_DIGIT 0xFF
+
+// The two hex digits of each byte value, so a byte is encoded with one
+// lookup.
+static const char HexPairs[] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+// The value of each character as a base-36 digit: 0-9, then A-Z in either
+// case. Hex fields accept the same digits, as they always have.
+static const uint8_t FromAsciiDigits[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+    0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+    0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
 
 //----------------------------------------------------------------------------
-// Supports up to base-36
 static bool FromAscii(char c, uint8_t& value) {
-    // 0-9?
-    if (c >= '0' && c <= '9') {
-        value = c - '0';
-        return true;
-    } else {
-        // A-Z?
-        c &= ~0x20;
-        if (c >= 'A' && c <= 'Z') {
-            value = 10 + c - 'A';
-            return true;
-        }
-    }
-    return false;
+    uint8_t digit = FromAsciiDigits[(uint8_t)c];
+    if (digit == NOT_A_DIGIT)
+        return false;
+    value = digit;
+    return true;
 }
 
+EWireFormat Message::s_defaultFormat = WIRE_FORMAT_ASCII;
+
 //----------------------------------------------------------------------------
 Message::Message(int length) {
+    this->wireFormat = s_defaultFormat;
     this->readptr = 0;
     this->writeptr = 0;
     this->initBuffer(length);
@@ -37,6 +70,7 @@ Message::Message(int length) {
 
 //----------------------------------------------------------------------------
 Message::Message(const char* src) {
+    this->wireFormat = s_defaultFormat;
     this->readptr = 0;
     this->maxlen = this->writeptr = strlen(src);
     this->initBuffer(src, this->maxlen);
@@ -44,6 +78,7 @@ Message::Message(const char* src) {
 
 //----------------------------------------------------------------------------
 Message::Message(const char* chars, int length) {
+    this->wireFormat = s_defaultFormat;
     this->readptr = 0;
     this->writeptr = length;
     this->initBuffer(chars, length);
@@ -51,32 +86,35 @@ Message::Message(const char* chars, int length) {
 
 //----------------------------------------------------------------------------
 Message::Message(const Message& msg, bool copy) {
+    this->wireFormat = msg.wireFormat;
     this->readptr = 0;
-    this->writeptr = msg.maxlen;
+    this->writeptr = msg.writeptr;
     if (copy) {
-        this->initBuffer(msg.maxlen);
-        memcpy(this->buf, msg.buf, msg.maxlen);
+        this->copyBuffer(msg);
     } else {
-        this->initBuffer(msg.buf, msg.maxlen);
+        this->initBuffer(msg.buf, msg.writeptr);
     }
 }
 
 //----------------------------------------------------------------------------
 Message::Message() {
     this->allocated = false;
+    this->wireFormat = s_defaultFormat;
     this->readptr = this->writeptr = this->maxlen = 0;
+    this->finalizedLength = 0;
     this->buf = NULL;
 }
 
 //----------------------------------------------------------------------------
 Message::~Message() {
-    if (this->allocated)
-        delete[] this->buf;
+    this->freeBuffer();
 }
 
 //----------------------------------------------------------------------------
+// Start of the bytes to send on the wire. For binary messages this is the
+// frame, which begins ahead of the payload.
 uint8_t* Message::byteBuffer() const {
-    return (uint8_t*)(void*)this->buf;
+    return (uint8_t*)(void*)(this->buf - this->headerSize());
 }
 
 //----------------------------------------------------------------------------
@@ -93,25 +131,153 @@ int Message::length() const {
 int Message::finalize() {
     if (!this->allocated)
         return 0;
-    this->buf[this->writeptr] = '\n';
-    return this->writeptr + 1;
+    if (this->finalizedLength)
+        return this->finalizedLength;
+    if (this->wireFormat == WIRE_FORMAT_BINARY) {
+        this->finalizedLength = frameEncode(this->byteBuffer(), this->writeptr);
+    } else {
+        this->buf[this->writeptr] = '\n';
+        this->finalizedLength = this->writeptr + 1;
+    }
+    return this->finalizedLength;
+}
+
+//----------------------------------------------------------------------------
+EWireFormat Message::format() const {
+    return this->wireFormat;
+}
+
+//----------------------------------------------------------------------------
+void Message::setDefaultFormat(EWireFormat format) {
+    s_defaultFormat = format;
+}
+
+//----------------------------------------------------------------------------
+EWireFormat Message::defaultFormat() {
+    return s_defaultFormat;
 }
 
 //----------------------------------------------------------------------------
 void Message::initBuffer(int length) {
+    int overhead = 1;  // include a char for the finalized newline.
+    if (this->wireFormat == WIRE_FORMAT_BINARY) {
+        if (length > FRAME_MAX_PAYLOAD)
+            length = FRAME_MAX_PAYLOAD;
+        overhead = FRAME_OVERHEAD;
+    }
+    this->finalizedLength = 0;
+    char* block = MessagePool::alloc(length + overhead);
+    if (!block) {
+        // Pool exhausted. The message stays empty and every write fails.
+        this->allocated = false;
+        this->buf = NULL;
+        this->maxlen = this->writeptr = 0;
+        return;
+    }
+    memset(block, 0, length + overhead);
     this->allocated = true;
-    this->buf = new char[length + 1];  // include a char for the finalized newline.
+    this->buf = block + this->headerSize();
     this->maxlen = length;
-    memset(this->buf, 0, length + 1);
 }
 
 //----------------------------------------------------------------------------
 void Message::initBuffer(const char* chars, int length) {
     this->allocated = false;
+    this->finalizedLength = 0;
     this->buf = (char*)chars;
     this->maxlen = this->writeptr = length;
 }
 
+//----------------------------------------------------------------------------
+void Message::copyBuffer(const Message& msg) {
+    this->initBuffer(msg.writeptr);
+    if (this->allocated) {
+        memcpy(this->buf, msg.buf, this->maxlen);
+        this->writeptr = this->maxlen;
+    }
+}
+
+//----------------------------------------------------------------------------
+void Message::freeBuffer() {
+    if (this->allocated)
+        MessagePool::free(this->buf - this->headerSize());
+    this->allocated = false;
+}
+
+//----------------------------------------------------------------------------
+// Binary frames are received one byte into the block, so that once decoded
+// in place the payload lands exactly where buf points.
+uint8_t* Message::receiveBuffer(int& capacity) const {
+    if (!this->allocated) {
+        capacity = 0;
+        return NULL;
+    }
+    if (this->wireFormat == WIRE_FORMAT_BINARY) {
+        capacity = this->maxlen + FRAME_OVERHEAD - 1;
+        return (uint8_t*)(void*)(this->buf - 1);
+    }
+    capacity = this->maxlen;
+    return (uint8_t*)(void*)this->buf;
+}
+
+//----------------------------------------------------------------------------
+bool Message::endReceive(int length) {
+    this->readptr = 0;
+    this->writeptr = 0;
+    if (!this->allocated)
+        return false;
+    if (this->wireFormat == WIRE_FORMAT_BINARY) {
+        uint8_t* payload;
+        int payloadLength;
+        if (!frameDecode(this->byteBuffer() + 1, length, payload, payloadLength))
+            return false;
+        length = payloadLength;
+    }
+    this->writeptr = length;
+    return true;
+}
+
+//----------------------------------------------------------------------------
+void Message::take(Message& msg) {
+    if (!msg.allocated) {
+        this->copyFrom(msg);
+        return;
+    }
+    this->freeBuffer();
+    this->buf = msg.buf;
+    this->allocated = true;
+    this->wireFormat = msg.wireFormat;
+    this->maxlen = msg.maxlen;
+    this->readptr = 0;
+    this->writeptr = msg.writeptr;
+    this->finalizedLength = msg.finalizedLength;
+    msg.allocated = false;
+    msg.release();
+}
+
+//----------------------------------------------------------------------------
+void Message::clear() {
+    if (!this->allocated)
+        return;
+    this->readptr = this->writeptr = 0;
+    this->finalizedLength = 0;
+}
+
+//----------------------------------------------------------------------------
+void Message::release() {
+    this->freeBuffer();
+    this->buf = NULL;
+    this->readptr = this->writeptr = this->maxlen = 0;
+    this->finalizedLength = 0;
+}
+
+//----------------------------------------------------------------------------
+int Message::headerSize() const {
+    if (this->allocated && this->wireFormat == WIRE_FORMAT_BINARY)
+        return FRAME_HEADER_SIZE;
+    return 0;
+}
+
 //----------------------------------------------------------------------------
 void Message::rewind() const {
     this->readptr = 0;
@@ -162,17 +328,17 @@ bool Message::readCharRaw(char& value) const {
 
 //----------------------------------------------------------------------------
 bool Message::readU16Hex(uint16_t& value) const {
-    uint8_t msb;
-    uint8_t lsb;
-
-    if (!this->readU8HexRaw(msb))
+    uint32_t number;
+    if (!this->readNumberRaw(2, number))
         return false;
-    if (!this->readU8HexRaw(lsb))
-        return false;
-
-    value = msb << 8;
-    value += lsb;
+    value = number;
+    return this->consumeSeparator();
+}
 
+//----------------------------------------------------------------------------
+bool Message::readU32Hex(uint32_t& value) const {
+    if (!this->readNumberRaw(4, value))
+        return false;
     return this->consumeSeparator();
 }
 
@@ -185,17 +351,45 @@ bool Message::readU8Hex(uint8_t& value) const {
 
 //----------------------------------------------------------------------------
 bool Message::readU8HexRaw(uint8_t& value) const {
-    uint8_t msn;
-    uint8_t lsn;
-
-    if (!this->readAsciiNybble(msn))
-        return false;
-    if (!this->readAsciiNybble(lsn))
+    uint32_t number;
+    if (!this->readNumberRaw(1, number))
         return false;
+    value = number;
+    return true;
+}
 
-    value = msn << 4;
-    value += lsn;
-
+//----------------------------------------------------------------------------
+// Reads a big-endian number of count bytes, as 2 * count digits or count
+// raw bytes, checking the bounds once for the whole field. Nothing is
+// consumed if it doesn't parse.
+bool Message::readNumberRaw(int count, uint32_t& value) const {
+    const uint8_t* src = (const uint8_t*)this->buf + this->readptr;
+    uint32_t number = 0;
+    if (this->wireFormat == WIRE_FORMAT_BINARY) {
+        if (this->writeptr - this->readptr < count)
+            return false;
+        for (int i = 0; i < count; ++i) {
+            number = (number << 8) | src[i];
+        }
+        this->readptr += count;
+        value = number;
+        return true;
+    }
+    if (this->writeptr - this->readptr < 2 * count)
+        return false;
+    // Digits are at most 35, so a bad one shows as the top bit of them all
+    // ORed together.
+    uint8_t digits = 0;
+    for (int i = 0; i < count; ++i, src += 2) {
+        uint8_t hi = FromAsciiDigits[src[0]];
+        uint8_t lo = FromAsciiDigits[src[1]];
+        digits |= hi | lo;
+        number = (number << 8) | (uint8_t)((hi << 4) + lo);
+    }
+    if (digits & 0x80)
+        return false;
+    this->readptr += 2 * count;
+    value = number;
     return true;
 }
 
@@ -221,8 +415,10 @@ bool Message::readCharsRaw(char* dst, int bufsize, int& nread) const {
 }
 
 //----------------------------------------------------------------------------
+// Bytes received but not yet read. A received message's buffer is usually
+// larger than what arrived, so this stops at writeptr rather than maxlen.
 int Message::bytesRemaining() const {
-    return this->maxlen - this->readptr;
+    return this->writeptr - this->readptr;
 }
 
 //----------------------------------------------------------------------------
@@ -243,38 +439,74 @@ bool Message::readString(ManagedString& str) const {
 bool Message::readImage(MicroBitImage& image) const {
     if (!this->readable())
         return false;
-    char packed[5];
-    int nread;
-    // Image is 5 x 5, black and white. Each row is encoded into a single ascii
-    // character as a base-36 encoded set of values.
-    if (!this->readCharsRaw(packed, 5, nread) || nread != 5)
-        return false;
-    if (!this->consumeSeparator())
-        return false;
     uint8_t pixels[25];
-    for (int y = 0; y < 5; ++y) {
-        uint8_t pixel = 0;
-        FromAscii(packed[y], pixel);
-        for (int x = 0; x < 5; ++x) {
-            pixels[y * 5 + (4 - x)] = (pixel & (1 << x)) ? 255 : 0;
+    if (this->consumeRaw(GREYSCALE_IMAGE_MARKER)) {
+        if (!this->readGreyscalePixels(pixels))
+            return false;
+    } else {
+        char packed[5];
+        int nread;
+        // Image is 5 x 5, black and white. Each row is encoded into a single
+        // ascii character as a base-36 encoded set of values. Binary messages
+        // send the row bits as a raw byte instead.
+        if (!this->readCharsRaw(packed, 5, nread) || nread != 5)
+            return false;
+        for (int y = 0; y < 5; ++y) {
+            uint8_t pixel = 0;
+            if (this->wireFormat == WIRE_FORMAT_BINARY)
+                pixel = (uint8_t)packed[y];
+            else
+                FromAscii(packed[y], pixel);
+            for (int x = 0; x < 5; ++x) {
+                pixels[y * 5 + (4 - x)] = (pixel & (1 << x)) ? 255 : 0;
+            }
         }
     }
+    if (!this->consumeSeparator())
+        return false;
     image = MicroBitImage(5, 5, pixels);
     return true;
 }
 
 //----------------------------------------------------------------------------
-bool Message::readAsciiNybble(uint8_t& value) const {
-    if (!this->readable())
+// A greyscale image follows its marker as a run count, then that many runs
+// of <(length - 1):4 bits><level:4 bits>, in hex or raw bytes like any other
+// byte field. The runs cover the 25 pixels in row order, and level 15 is
+// full brightness.
+bool Message::readGreyscalePixels(uint8_t* pixels) const {
+    uint8_t runCount;
+    if (!this->readU8HexRaw(runCount))
         return false;
+    int count = 0;
+    while (runCount--) {
+        uint8_t run;
+        if (!this->readU8HexRaw(run))
+            return false;
+        int length = (run >> 4) + 1;
+        if (count + length > 25)
+            return false;
+        memset(pixels + count, (run & 0x0F) * 17, length);
+        count += length;
+    }
+    return count == 25;
+}
 
-    char c = this->buf[this->readptr];
-
-    if (!FromAscii(c, value))
+//----------------------------------------------------------------------------
+// Reads a length-prefixed message, encoded like a String, and makes inner a
+// view of it. No copy is made; inner is only valid while this message is.
+bool Message::readMessage(Message& inner) const {
+    if (!this->readable())
         return false;
-
-    ++this->readptr;
-    return true;
+    uint8_t len;
+    if (!this->readU8HexRaw(len))
+        return false;
+    if (len > this->bytesRemaining())
+        return false;
+    inner.release();
+    inner.wireFormat = this->wireFormat;
+    inner.initBuffer(this->buf + this->readptr, len);
+    this->readptr += len;
+    return this->consumeSeparator();
 }
 
 //----------------------------------------------------------------------------
@@ -290,20 +522,28 @@ bool Message::writeString(const char* value, bool truncate) {
     return this->writeSeparator();
 }
 
+//----------------------------------------------------------------------------
+bool Message::writeStringField(const char* value, int count) {
+    if (count < 0 || count > 0xFF)
+        return false;
+    if (!this->writeAsciiByte(count))
+        return false;
+    if (!this->writeCharsRaw(value, count, false))
+        return false;
+    return this->writeSeparator();
+}
+
 //----------------------------------------------------------------------------
 bool Message::writeChars(const char* value, int count, bool truncate) {
-    if (!this->writable(count)) {
-        count = this->maxlen - this->writeptr - 1;
-        if (!truncate || !this->writable(count))
-            return false;
-    }
-    memcpy(this->buf + this->writeptr, value, count);
-    this->writeptr += count;
+    if (!this->writeCharsRaw(value, count, truncate))
+        return false;
     return this->writeSeparator();
 }
 
 //----------------------------------------------------------------------------
 bool Message::writeCharsRaw(const char* value, int count, bool truncate) {
+    if (count < 0)
+        return false;
     if (!this->writable(count)) {
         count = this->maxlen - this->writeptr - 1;
         if (!truncate || !this->writable(count))
@@ -339,15 +579,35 @@ bool Message::writeU16Hex(uint16_t value) {
 
 //----------------------------------------------------------------------------
 bool Message::writeU16HexRaw(uint16_t value) {
-    if (!this->writable(4))
+    return this->writeNumberRaw(2, value);
+}
+
+//----------------------------------------------------------------------------
+bool Message::writeU32Hex(uint32_t value) {
+    if (!this->writeNumberRaw(4, value))
         return false;
-    uint8_t hi = (value >> 8) & 0xFF;
-    uint8_t lo = value & 0xFF;
-    if (!writeAsciiByte(hi))
+    return this->writeSeparator();
+}
+
+//----------------------------------------------------------------------------
+bool Message::writeBytes(const uint8_t* value, int count) {
+    if (count < 0 || count > 0xFF)
         return false;
-    if (!writeAsciiByte(lo))
+    int width = this->wireFormat == WIRE_FORMAT_BINARY ? 1 : 2;
+    if (!this->writable(width * (count + 1)))
         return false;
-    return true;
+    this->writeAsciiByte(count);
+    char* dst = this->buf + this->writeptr;
+    for (int i = 0; i < count; ++i) {
+        if (this->wireFormat == WIRE_FORMAT_BINARY) {
+            *dst++ = (char)value[i];
+        } else {
+            *dst++ = HexPairs[2 * value[i]];
+            *dst++ = HexPairs[2 * value[i] + 1];
+        }
+    }
+    this->writeptr += width * count;
+    return this->writeSeparator();
 }
 
 //----------------------------------------------------------------------------
@@ -359,25 +619,48 @@ bool Message::writeU8Hex(uint8_t value) {
 
 //----------------------------------------------------------------------------
 bool Message::writeAsciiByte(uint8_t value) {
-    if (!this->writable(2))
-        return false;
-    uint8_t hi = (value >> 4) & 0x0F;
-    uint8_t lo = value & 0x0F;
-    if (!this->writeCharRaw(ToAscii[hi]))
-        return false;
-    if (!this->writeCharRaw(ToAscii[lo]))
+    return this->writeNumberRaw(1, value);
+}
+
+//----------------------------------------------------------------------------
+// Writes a big-endian number of count bytes, as 2 * count hex digits or
+// count raw bytes, checking for room once for the whole field.
+bool Message::writeNumberRaw(int count, uint32_t value) {
+    int length = this->wireFormat == WIRE_FORMAT_BINARY ? count : 2 * count;
+    if (!this->writable(length))
         return false;
+    char* dst = this->buf + this->writeptr;
+    for (int shift = 8 * (count - 1); shift >= 0; shift -= 8) {
+        uint8_t byte = value >> shift;
+        if (this->wireFormat == WIRE_FORMAT_BINARY) {
+            *dst++ = (char)byte;
+        } else {
+            *dst++ = HexPairs[2 * byte];
+            *dst++ = HexPairs[2 * byte + 1];
+        }
+    }
+    this->writeptr += length;
     return true;
 }
 
 //----------------------------------------------------------------------------
 bool Message::consumeSeparator() const {
+    if (this->wireFormat == WIRE_FORMAT_BINARY)
+        return true;  // binary fields are fixed width
+    if (!this->readable())
+        return false;
     char value = this->buf[this->readptr++];
     return value == '|';
 }
 
 //----------------------------------------------------------------------------
 bool Message::writeSeparator() {
+    if (this->wireFormat == WIRE_FORMAT_BINARY)
+        return true;
+    // The field before it was allowed to end one short of maxlen, leaving
+    // room for exactly this.
+    if (!this->writable(0))
+        return false;
     this->buf[this->writeptr++] = '|';
     return true;
 }
@@ -391,9 +674,11 @@ bool Message::readable() const {
 
 //----------------------------------------------------------------------------
 bool Message::writable(int length) const {
+    if (length < 0)
+        return false;
     if (!this->allocated)
         return false;  // We didn't allocate this buffer
-    if (this->buf[this->writeptr] == '\n')
+    if (this->finalizedLength)
         return false;  // message has been finalized
     if (this->writeptr + length >= this->maxlen)
         return false;  // out of space
@@ -402,10 +687,8 @@ bool Message::writable(int length) const {
 
 //----------------------------------------------------------------------------
 void Message::copyFrom(const Message& msg) {
-    if (this->allocated)
-        delete[] this->buf;
+    this->freeBuffer();
+    this->wireFormat = msg.wireFormat;
     this->readptr = 0;
-    this->writeptr = msg.maxlen;
-    this->initBuffer(msg.maxlen);
-    memcpy(this->buf, msg.buf, msg.maxlen);
+    this->copyBuffer(msg);
 }
@@ -1,9 +1,18 @@
 #ifndef MESSAGE_H
 #define MESSAGE_H
 
+#include <stdint.h>
+
 class ManagedString;
 class MicroBitImage;
 
+enum EWireFormat {
+    // Hex-encoded fields separated by '|', terminated by '\n'.
+    WIRE_FORMAT_ASCII = 0,
+    // Raw big-endian fields in a COBS/CRC frame. See Framing.h.
+    WIRE_FORMAT_BINARY = 1,
+};
+
 class Message {
    public:
     Message(int length);
@@ -17,6 +26,11 @@ class Message {
     char* charBuffer() const;
     int length() const;
     int finalize();
+    EWireFormat format() const;
+
+    // Format given to messages created from here on.
+    static void setDefaultFormat(EWireFormat format);
+    static EWireFormat defaultFormat();
 
     // Read
     void rewind() const;
@@ -26,34 +40,64 @@ class Message {
     bool readChars(char* dst, int bufsize, int& nread) const;
     bool readU8Hex(uint8_t& value) const;
     bool readU16Hex(uint16_t& value) const;
+    bool readU32Hex(uint32_t& value) const;
     bool readString(ManagedString& str) const;
     bool readImage(MicroBitImage& image) const;
+    bool readMessage(Message& inner) const;
     int bytesRemaining() const;
 
     // Write
     bool writeChar(char value);
     bool writeChars(const char* value, int count, bool truncate = false);
     bool writeString(const char* value, bool truncate = false);
+    // A String field as readString reads it, for commands sent to the
+    // device; unlike writeString it always ends in a separator.
+    bool writeStringField(const char* value, int count);
     bool writeU8Hex(uint8_t value);
     bool writeU16Hex(uint16_t value);
+    bool writeU32Hex(uint32_t value);
+    // A length byte, then count bytes: raw in binary messages, hex pairs in
+    // ASCII ones.
+    bool writeBytes(const uint8_t* value, int count);
+
+    // Receive: raw wire bytes are written to receiveBuffer(), then
+    // endReceive() strips the framing in place. Returns false if the bytes
+    // don't form a valid message.
+    uint8_t* receiveBuffer(int& capacity) const;
+    bool endReceive(int length);
 
     // copy
     void copyFrom(const Message& msg);
+    // Takes over msg's buffer when it owns one, leaving msg empty, and
+    // copies it otherwise.
+    void take(Message& msg);
+    // Returns the buffer to the pool, leaving an empty message.
+    void release();
+    // Discards written content so the buffer can be reused.
+    void clear();
 
    private:
     char* buf;
     bool allocated;
+    EWireFormat wireFormat;
     int maxlen;
     mutable int readptr;
     int writeptr;
+    int finalizedLength;
+
+    static EWireFormat s_defaultFormat;
 
     void initBuffer(int length);
     void initBuffer(const char* chars, int length);
+    void copyBuffer(const Message& msg);
+    void freeBuffer();
+    int headerSize() const;
 
-    bool readAsciiNybble(uint8_t& value) const;
     bool writeAsciiByte(uint8_t value);
 
+    bool readNumberRaw(int count, uint32_t& value) const;
     bool readU8HexRaw(uint8_t& value) const;
+    bool readGreyscalePixels(uint8_t* pixels) const;
     bool readCharRaw(char& value) const;
     bool readCharsRaw(char* dst, int bufsize, int& nread) const;
     bool consumeRaw(char value) const;
@@ -62,6 +106,7 @@ class Message {
     bool writeCharsRaw(const char* value, int count, bool truncate);
     bool writeCharRaw(char value);
     bool writeU16HexRaw(uint16_t value);
+    bool writeNumberRaw(int count, uint32_t value);
     bool writeSeparator();
 
     bool readable() const;
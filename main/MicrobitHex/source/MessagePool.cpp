@@ -0,0 +1,70 @@
+#include "MessagePool.h"
+
+//============================================================================
+
+static char s_smallSlabs[MESSAGE_POOL_SMALL_SLAB_COUNT][MESSAGE_POOL_SMALL_SLAB_SIZE];
+static char s_largeSlabs[MESSAGE_POOL_LARGE_SLAB_COUNT][MESSAGE_POOL_LARGE_SLAB_SIZE];
+static uint8_t s_smallUsed;  // bitmask of slabs in use
+static uint8_t s_largeUsed;
+static MessagePoolStats s_stats;
+
+//----------------------------------------------------------------------------
+static char* allocSlab(char* slabs, int slabSize, int slabCount, uint8_t& used) {
+    for (int i = 0; i < slabCount; ++i) {
+        if (!(used & (1 << i))) {
+            used |= (1 << i);
+            return slabs + i * slabSize;
+        }
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+static bool freeSlab(char* block, char* slabs, int slabSize, int slabCount, uint8_t& used) {
+    if (block < slabs || block >= slabs + slabSize * slabCount)
+        return false;
+    used &= ~(1 << ((block - slabs) / slabSize));
+    return true;
+}
+
+//----------------------------------------------------------------------------
+char* MessagePool::alloc(int size) {
+    char* block = NULL;
+    if (size <= MESSAGE_POOL_SMALL_SLAB_SIZE) {
+        block = allocSlab(&s_smallSlabs[0][0], MESSAGE_POOL_SMALL_SLAB_SIZE,
+                          MESSAGE_POOL_SMALL_SLAB_COUNT, s_smallUsed);
+    }
+    if (!block && size <= MESSAGE_POOL_LARGE_SLAB_SIZE) {
+        block = allocSlab(&s_largeSlabs[0][0], MESSAGE_POOL_LARGE_SLAB_SIZE,
+                          MESSAGE_POOL_LARGE_SLAB_COUNT, s_largeUsed);
+    }
+    if (!block) {
+        s_stats.exhaustedCount++;
+        return NULL;
+    }
+    s_stats.inUse++;
+    if (s_stats.inUse > s_stats.highWaterMark)
+        s_stats.highWaterMark = s_stats.inUse;
+    return block;
+}
+
+//----------------------------------------------------------------------------
+void MessagePool::free(char* block) {
+    if (freeSlab(block, &s_smallSlabs[0][0], MESSAGE_POOL_SMALL_SLAB_SIZE,
+                 MESSAGE_POOL_SMALL_SLAB_COUNT, s_smallUsed) ||
+        freeSlab(block, &s_largeSlabs[0][0], MESSAGE_POOL_LARGE_SLAB_SIZE,
+                 MESSAGE_POOL_LARGE_SLAB_COUNT, s_largeUsed)) {
+        s_stats.inUse--;
+    }
+}
+
+//----------------------------------------------------------------------------
+void MessagePool::getStats(MessagePoolStats& stats) {
+    stats = s_stats;
+}
+
+//----------------------------------------------------------------------------
+void MessagePool::resetStats() {
+    s_stats.highWaterMark = s_stats.inUse;
+    s_stats.exhaustedCount = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed, statically allocated storage for Message buffers, so building and
+// copying messages never touches the heap.
+//
+// Small slabs hold outgoing events; large slabs hold received commands,
+// queued display commands, sampled state, stats replies and capture blocks.
+// A small request falls back to a large slab when the small ones are all in
+// use. When both are exhausted, alloc returns NULL and the exhaustion is
+// counted.
+
+// Each size's slabs in use are tracked in one byte, so there can be at most
+// 8 of each.
+#define MESSAGE_POOL_SMALL_SLAB_SIZE 64
+#define MESSAGE_POOL_SMALL_SLAB_COUNT 8
+#define MESSAGE_POOL_LARGE_SLAB_SIZE 136
+#define MESSAGE_POOL_LARGE_SLAB_COUNT 8
+
+struct MessagePoolStats {
+    uint8_t inUse;
+    uint8_t highWaterMark;
+    uint16_t exhaustedCount;
+};
+
+class MessagePool {
+   public:
+    static char* alloc(int size);
+    static void free(char* block);
+
+    static void getStats(MessagePoolStats& stats);
+    static void resetStats();
+};
+
+#endif  // MESSAGE_POOL_H
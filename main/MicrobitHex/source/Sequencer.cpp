@@ -0,0 +1,119 @@
+#include "Sequencer.h"
+
+#include <string.h>
+
+//============================================================================
+
+//----------------------------------------------------------------------------
+Sequencer::Sequencer(ToneFn tone) {
+    this->tone = tone;
+    memset(this->tracks, 0, sizeof(this->tracks));
+    this->resetStats();
+}
+
+//----------------------------------------------------------------------------
+void Sequencer::play(int track, const MelodyNote* notes, int count, uint8_t loops, uint8_t bpm, unsigned long nowMs) {
+    if (track < 0 || track >= SEQUENCER_TRACKS)
+        return;
+    if (count <= 0 || count > 255) {
+        return this->stop(track);
+    }
+    Track& t = this->tracks[track];
+    t.notes = notes;
+    t.count = count;
+    t.index = 0;
+    t.loops = loops;
+    t.bpm = bpm ? bpm : SEQUENCER_BASE_BPM;
+    t.active = true;
+    this->startNote(track, nowMs);
+}
+
+//----------------------------------------------------------------------------
+bool Sequencer::playCopy(int track, const MelodyNote* notes, int count, uint8_t loops, uint8_t bpm, unsigned long nowMs) {
+    if (track < 0 || track >= SEQUENCER_TRACKS || count > SEQUENCER_MAX_NOTES)
+        return false;
+    memcpy(this->copies[track], notes, count * sizeof(MelodyNote));
+    this->play(track, this->copies[track], count, loops, bpm, nowMs);
+    return true;
+}
+
+//----------------------------------------------------------------------------
+void Sequencer::stop(int track) {
+    if (track < 0 || track >= SEQUENCER_TRACKS)
+        return;
+    if (this->tracks[track].active) {
+        this->tracks[track].active = false;
+        this->tone(track, 0);
+    }
+}
+
+//----------------------------------------------------------------------------
+void Sequencer::stopAll() {
+    for (int i = 0; i < SEQUENCER_TRACKS; ++i) {
+        this->stop(i);
+    }
+}
+
+//----------------------------------------------------------------------------
+bool Sequencer::playing(int track) const {
+    return track >= 0 && track < SEQUENCER_TRACKS && this->tracks[track].active;
+}
+
+//----------------------------------------------------------------------------
+long Sequencer::update(unsigned long nowMs) {
+    long wait = -1;
+    for (int i = 0; i < SEQUENCER_TRACKS; ++i) {
+        Track& t = this->tracks[i];
+        if (!t.active || t.held)
+            continue;
+        if ((long)(t.dueMs - nowMs) <= 0) {
+            unsigned long lateMs = nowMs - t.dueMs;
+            this->stats.noteCount++;
+            this->stats.totalLateMs += lateMs;
+            if (lateMs > this->stats.maxLateMs)
+                this->stats.maxLateMs = lateMs > 0xFFFF ? 0xFFFF : (uint16_t)lateMs;
+        }
+        // Each note starts when the last one was due to end rather than when
+        // it was noticed, so lateness doesn't accumulate.
+        while (t.active && !t.held && (long)(t.dueMs - nowMs) <= 0) {
+            if (++t.index >= t.count) {
+                if (t.loops != 1) {
+                    if (t.loops)
+                        t.loops--;
+                    t.index = 0;
+                } else {
+                    this->stop(i);
+                    break;
+                }
+            }
+            this->startNote(i, t.dueMs);
+        }
+        if (t.active && !t.held) {
+            long remaining = (long)(t.dueMs - nowMs);
+            if (wait < 0 || remaining < wait)
+                wait = remaining;
+        }
+    }
+    return wait;
+}
+
+//----------------------------------------------------------------------------
+void Sequencer::getStats(SequencerStats& stats) const {
+    stats = this->stats;
+}
+
+//----------------------------------------------------------------------------
+void Sequencer::resetStats() {
+    memset(&this->stats, 0, sizeof(this->stats));
+}
+
+//----------------------------------------------------------------------------
+void Sequencer::startNote(int track, unsigned long startMs) {
+    Track& t = this->tracks[track];
+    const MelodyNote& note = t.notes[t.index];
+    this->tone(track, note.frequency);
+    t.held = note.durationMs == 0;
+    unsigned long durationMs = (unsigned long)note.durationMs * SEQUENCER_BASE_BPM / t.bpm;
+    // A note always takes some time, so a looping track can't spin.
+    t.dueMs = startMs + (durationMs ? durationMs : 1);
+}
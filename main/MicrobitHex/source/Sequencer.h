@@ -0,0 +1,72 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <stdint.h>
+
+#include "Melodies.h"
+
+// One track per tone pin.
+#define SEQUENCER_TRACKS 3
+// Most notes a track can hold a copy of.
+#define SEQUENCER_MAX_NOTES 32
+// Tempo at which note durations are given.
+#define SEQUENCER_BASE_BPM 120
+
+// How late note changes were, relative to when they were due.
+struct SequencerStats {
+    uint32_t noteCount;
+    uint32_t totalLateMs;
+    uint16_t maxLateMs;
+};
+
+// Plays lists of notes on several tracks at once, without a fiber per track.
+// The owner calls update() with the current time; it switches any notes
+// that are due through the tone callback and says when to call again.
+//
+// A note with a frequency of 0 is a rest, and one with a duration of 0 is
+// held until the track is stopped or replaced.
+class Sequencer {
+   public:
+    // Sets track's output to frequency, or silences it when 0.
+    typedef void (*ToneFn)(int track, uint16_t frequency);
+
+    explicit Sequencer(ToneFn tone);
+
+    // Starts notes on track, replacing whatever it was playing. They are
+    // played loops times, or forever when loops is 0, at bpm. notes is not
+    // copied and must stay valid while the track plays it.
+    void play(int track, const MelodyNote* notes, int count, uint8_t loops, uint8_t bpm, unsigned long nowMs);
+    // Like play, but takes a copy of up to SEQUENCER_MAX_NOTES notes.
+    bool playCopy(int track, const MelodyNote* notes, int count, uint8_t loops, uint8_t bpm, unsigned long nowMs);
+    void stop(int track);
+    void stopAll();
+    bool playing(int track) const;
+
+    // Plays any note changes due by nowMs. Returns the ms until the next
+    // change, or -1 if none is scheduled.
+    long update(unsigned long nowMs);
+
+    void getStats(SequencerStats& stats) const;
+    void resetStats();
+
+   private:
+    struct Track {
+        const MelodyNote* notes;
+        uint8_t count;
+        uint8_t index;
+        uint8_t loops;  // remaining, 0 for forever
+        uint8_t bpm;
+        bool active;
+        bool held;
+        unsigned long dueMs;  // when the current note ends
+    };
+
+    ToneFn tone;
+    Track tracks[SEQUENCER_TRACKS];
+    MelodyNote copies[SEQUENCER_TRACKS][SEQUENCER_MAX_NOTES];
+    SequencerStats stats;
+
+    void startNote(int track, unsigned long startMs);
+};
+
+#endif  // SEQUENCER_H
@@ -0,0 +1,94 @@
+#include "TxScheduler.h"
+
+#include <stddef.h>
+
+//============================================================================
+
+//----------------------------------------------------------------------------
+TxScheduler::TxScheduler() {
+    for (int i = 0; i < TX_PRIORITY_COUNT; ++i) {
+        this->lanes[i].head = 0;
+        this->lanes[i].count = 0;
+        this->lanes[i].depth = (i == TX_PRIORITY_TELEMETRY || i == TX_PRIORITY_BULK) ? 1 : TX_QUEUE_DEPTH;
+    }
+}
+
+//----------------------------------------------------------------------------
+bool TxScheduler::push(Message& msg, ETxPriority priority) {
+    if (priority < 0 || priority >= TX_PRIORITY_COUNT)
+        return false;
+    Lane& lane = this->lanes[priority];
+    if (lane.count >= lane.depth) {
+        if (priority != TX_PRIORITY_TELEMETRY)
+            return false;
+        // The newest frame supersedes the one still waiting.
+        lane.slots[lane.head].take(msg);
+        if (lane.slots[lane.head].length())
+            return true;
+        lane.slots[lane.head].release();
+        lane.count = 0;
+        return false;
+    }
+    Message& slot = lane.slots[(lane.head + lane.count) % TX_QUEUE_DEPTH];
+    slot.take(msg);
+    if (!slot.length()) {
+        slot.release();
+        return false;
+    }
+    lane.count++;
+    return true;
+}
+
+//----------------------------------------------------------------------------
+bool TxScheduler::pending(ETxPriority priority) const {
+    return priority >= 0 && priority < TX_PRIORITY_COUNT && this->lanes[priority].count > 0;
+}
+
+//----------------------------------------------------------------------------
+bool TxScheduler::full(ETxPriority priority) const {
+    if (priority < 0 || priority >= TX_PRIORITY_COUNT)
+        return true;
+    const Lane& lane = this->lanes[priority];
+    return priority != TX_PRIORITY_TELEMETRY && lane.count >= lane.depth;
+}
+
+//----------------------------------------------------------------------------
+void TxScheduler::clear() {
+    for (int i = 0; i < TX_PRIORITY_COUNT; ++i) {
+        Lane& lane = this->lanes[i];
+        while (lane.count) {
+            lane.slots[lane.head].release();
+            lane.head = (lane.head + 1) % TX_QUEUE_DEPTH;
+            lane.count--;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+Message* TxScheduler::peek() {
+    int i = this->frontLane();
+    if (i < 0)
+        return NULL;
+    return &this->lanes[i].slots[this->lanes[i].head];
+}
+
+//----------------------------------------------------------------------------
+bool TxScheduler::pop(Message& msg) {
+    int i = this->frontLane();
+    if (i < 0)
+        return false;
+    Lane& lane = this->lanes[i];
+    msg.take(lane.slots[lane.head]);
+    lane.head = (lane.head + 1) % TX_QUEUE_DEPTH;
+    lane.count--;
+    return true;
+}
+
+//----------------------------------------------------------------------------
+int TxScheduler::frontLane() const {
+    for (int i = 0; i < TX_PRIORITY_COUNT; ++i) {
+        if (this->lanes[i].count)
+            return i;
+    }
+    return -1;
+}
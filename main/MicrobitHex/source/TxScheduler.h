@@ -0,0 +1,63 @@
+#ifndef TX_SCHEDULER_H
+#define TX_SCHEDULER_H
+
+#include <stdint.h>
+
+#include "Message.h"
+
+// Messages of each class that can wait to be sent. Telemetry and bulk
+// always hold just one.
+#define TX_QUEUE_DEPTH 3
+
+// Outgoing message classes, most urgent first.
+enum ETxPriority {
+    // Button, gesture and pin edge events.
+    TX_PRIORITY_INPUT = 0,
+    // Answers to commands: ping, stats, ACK/NACK.
+    TX_PRIORITY_REPLY = 1,
+    // Sampled state. Only the newest frame is kept.
+    TX_PRIORITY_TELEMETRY = 2,
+    // Sysmsgs: errors and benchmark results.
+    TX_PRIORITY_DIAGNOSTIC = 3,
+    // Captured sample blocks, which only use what the others leave. One at a
+    // time, since each takes a large pool slab.
+    TX_PRIORITY_BULK = 4,
+    TX_PRIORITY_COUNT = 5,
+};
+
+// Outgoing messages waiting for room in the serial TX buffer, so senders
+// never wait on the wire. A single sender takes them most urgent class
+// first, and oldest first within a class. Like CommandQueue, a pushed
+// message's buffer is taken over when the caller owns it.
+class TxScheduler {
+   public:
+    TxScheduler();
+
+    // Queues msg. A telemetry message replaces one still waiting. Returns
+    // false, leaving msg as it was, if its class is full.
+    bool push(Message& msg, ETxPriority priority);
+    bool pending(ETxPriority priority) const;
+    // Whether push() would refuse a message of this class. Telemetry is
+    // never full, since a new frame replaces the waiting one.
+    bool full(ETxPriority priority) const;
+    void clear();
+
+    // Sender side: the message to send next, or NULL. pop() takes it out of
+    // the queue into msg.
+    Message* peek();
+    bool pop(Message& msg);
+
+   private:
+    struct Lane {
+        Message slots[TX_QUEUE_DEPTH];
+        uint8_t head;
+        uint8_t count;
+        uint8_t depth;
+    };
+
+    Lane lanes[TX_PRIORITY_COUNT];
+
+    int frontLane() const;
+};
+
+#endif  // TX_SCHEDULER_H